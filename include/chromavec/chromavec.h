@@ -3,10 +3,21 @@
  * @brief Colour filtering with vector order statistics.
  * @author Richard Rzeszutek
  * @date June 25, 2018
+ *
+ * All of the filters accept either 8-bit (CV_8UC3) or 16-bit (CV_16UC3) colour
+ * images and process them at their native depth, so a 16-bit image doesn't
+ * need to be converted to 8 bits first.  The vector order-statistic filters
+ * output an image with the same depth as the input.  Any other image type is
+ * rejected with a std::runtime_error.
  */
 #ifndef CHROMAVEC_CHROMAVEC_H_
 #define CHROMAVEC_CHROMAVEC_H_
 
+#include <any>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
 #include <opencv2/core.hpp>
 
 #include <chromavec/version.h>
@@ -14,25 +25,198 @@
 namespace chromavec {
 
 /**
+ * The raw gradient image is a CV_16UC1 image where each pixel stores the
+ * gradient as `(magnitude << 2) | direction`.  The direction is the gradient
+ * angle as a multiple of 45-degrees, i.e. 0, 45, 90 or 135 degrees.  The
+ * gradients of a 16-bit image don't fit into 16 bits, so they are stored in a
+ * CV_32SC1 image instead.  The HSV output is always an 8-bit image.
+ *
  * @brief Gradient output modes.
  */
 enum GradientMode
 {
-    kDirectOutput,  ///< Output the raw gradient image.
+    kDirectOutput,  ///< Output the raw (packed) gradient image.
     kMagnitudeOnly, ///< Output the magnitude image.
     kToHSV          ///< Output the gradient as an RGB image with HSV colouring.
 };
 
+/**
+ * All of the filters compare colours with the Euclidean distance by default.
+ * The Manhattan distance is cheaper to compute and less sensitive to outliers,
+ * which gives more robust vector medians.  The Chebyshev distance only
+ * considers the colour channel with the largest difference.
+ *
+ * The gradient magnitudes, and therefore the Canny thresholds, are measured
+ * with the chosen metric.  The largest possible magnitude is 441 for the
+ * Euclidean distance, 765 for the Manhattan distance and 255 for the Chebyshev
+ * distance.  Magnitudes are measured in the units of the input image, so for a
+ * 16-bit image these are 257 times larger, i.e. 113509, 196605 and 65535.
+ *
+ * With the Euclidean distance, the Vector Median, Vector Range and Minimum
+ * Vector Dispersion filters sum up the squared distances in an `int` for
+ * 8-bit images, so their windows can be at most 103 pixels wide.  Wider
+ * windows throw a std::runtime_error.
+ *
+ * @brief Distance metrics used to compare colours.
+ */
+enum DistanceMetric
+{
+    kEuclidean,     ///< Euclidean (L2) distance.
+    kManhattan,     ///< Manhattan (L1) distance.
+    kChebyshev      ///< Chebyshev (L-infinity) distance.
+};
+
+/**
+ * Both searches produce exactly the same output.  The window search visits
+ * every pixel in the filtering window and its cost grows with the window area.
+ * The histogram search groups the window pixels by colour and only visits the
+ * groups that could contain the vector median, so its cost depends on the
+ * number of distinct colours in the window instead.  It is much faster for
+ * large windows (15x15 and up).  The histogram search is only available for
+ * the Euclidean distance and 8-bit images; the window search is always used
+ * otherwise.
+ *
+ * @brief Search strategies for the Vector Median filter.
+ */
+enum MedianSearch
+{
+    kSearchAuto,        ///< Choose the search based on the window size.
+    kSearchWindow,      ///< Search every pixel in the window.
+    kSearchHistogram    ///< Search through a colour histogram of the window.
+};
+
+/**
+ * @brief Strategies used to hand the tiles of an image out to the workers.
+ */
+enum TilePartitioner
+{
+    kPartitionAuto,     ///< Split adaptively, based on the load.
+    kPartitionSimple,   ///< Create one task per tile.
+    kPartitionStatic    ///< Split the tiles evenly across the workers.
+};
+
+/**
+ * The vector order-statistic filters, and the conversion of the gradients into
+ * magnitudes or HSV, split an image into tiles that are filtered in parallel.
+ * By default the tiles are sized so that a tile, and the pixels around it that
+ * the filter reads, fit into the L2 cache.  The gradient and the Canny
+ * detector work on horizontal strips of their own and aren't affected.
+ *
+ * @brief Controls how the filters split an image into parallel tasks.
+ */
+struct Tiling
+{
+    int rows = 0;   ///< rows in a tile; '0' chooses the size automatically
+    int cols = 0;   ///< columns in a tile; '0' chooses the size automatically
+    TilePartitioner partitioner = kPartitionAuto;   ///< tile scheduling
+};
+
+/**
+ * Several of the filters need intermediate images, e.g. the gradient image or
+ * the Canny edge classes.  A Workspace holds onto those images so that they can
+ * be reused between calls.  Processing a sequence of images with the same size
+ * (e.g. video frames) then doesn't need to reallocate them for every image.
+ * The buffers are an implementation detail and their contents shouldn't be
+ * relied upon.  A workspace must only be used by one call at a time.
+ *
+ * Along with the images, the workspace keeps the filters' per-thread scratch,
+ * e.g. the tile buffers, the filter operators and their sliding windows, the
+ * Canny strip buffers and the hysteresis stacks.  All of it only grows, so
+ * once an image has been filtered, filtering another image with the same size,
+ * type and filter doesn't allocate any of it again.  The one exception is the
+ * Gaussian pre-filter, where OpenCV allocates its own kernel and row buffers
+ * for every blur.
+ *
+ * The workspace also holds the Tiling used by the filters it's passed to, so
+ * the tiling can be tuned without changing any of the filtering functions.
+ * Release() leaves it as-is.
+ *
+ * @brief Reusable buffers for the filtering functions.
+ */
+struct Workspace
+{
+    cv::Mat gradient;   ///< colour gradient image
+    cv::Mat classes;    ///< Canny edge classes (strong, weak or none)
+    cv::Mat hsv;        ///< HSV colouring of the gradient
+    cv::Mat region;     ///< a filtered region, before it's copied out
+    std::vector<cv::Mat> tiles;         ///< per-thread tile buffers
+    std::vector<std::any> operators;    ///< per-thread filter operators
+    std::vector<cv::Mat> strips;        ///< per-thread pre-filtered rows
+    std::vector<cv::Mat> rings;         ///< per-thread Canny gradient rows
+    std::vector<std::vector<cv::Point>> stacks; ///< hysteresis stacks
+    Tiling tiling;                      ///< how the filters split an image
+
+    /**
+     * @brief Release all of the buffers.
+     */
+    void Release();
+};
+
+/**
+ * The statistics are only collected when a Stats object is passed into one of
+ * the filtering functions; otherwise none of the timing or counting is done.
+ * The pre-filter, gradient, non-maximum suppression and thresholding are fused
+ * into a single pass, so they're timed together.
+ *
+ * @brief Per-stage timings and counters for the Canny edge detector.
+ */
+struct Stats
+{
+    double classes_seconds = 0;     ///< blur, gradient, suppression, threshold
+    double counting_seconds = 0;    ///< counting the edge classes
+    double hysteresis_seconds = 0;  ///< connecting weak edges to strong ones
+    double output_seconds = 0;      ///< removing the remaining weak edges
+    double total_seconds = 0;       ///< the entire detector
+
+    int64_t strong_pixels = 0;      ///< pixels above the upper threshold
+    int64_t weak_pixels = 0;        ///< pixels between the two thresholds
+    int64_t none_pixels = 0;        ///< pixels that aren't edges
+    int64_t promoted_pixels = 0;    ///< weak pixels kept by the hysteresis
+
+    int hysteresis_strips = 0;      ///< strips flood-filled in parallel
+    int tasks = 0;                  ///< TBB tasks run by the detector
+};
+
 /**
  * @brief The Vector Median filter.
  * @param img
  *      input image
  * @param window
  *      filtering window size
+ * @param search
+ *      the strategy used to search the window; the histogram search is only
+ *      used for 8-bit images and the Euclidean distance, and the window search
+ *      is used otherwise
+ * @param metric
+ *      the distance used to compare colours
  * @return
  *      filtered image
  */
-cv::Mat VectorMedianFilter(const cv::Mat &img, const int window=5);
+cv::Mat VectorMedianFilter(const cv::Mat &img, const int window=5,
+                           const MedianSearch search=kSearchAuto,
+                           const DistanceMetric metric=kEuclidean);
+
+/**
+ * @brief The Vector Median filter.
+ * @param img
+ *      input image
+ * @param out
+ *      filtered image; reused if it already has the correct size and type
+ * @param workspace
+ *      reusable intermediate buffers
+ * @param window
+ *      filtering window size
+ * @param search
+ *      the strategy used to search the window; the histogram search is only
+ *      used for 8-bit images and the Euclidean distance, and the window search
+ *      is used otherwise
+ * @param metric
+ *      the distance used to compare colours
+ */
+void VectorMedianFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                        const int window=5,
+                        const MedianSearch search=kSearchAuto,
+                        const DistanceMetric metric=kEuclidean);
 
 /**
  * @brief The Vector Range filter.
@@ -40,10 +224,30 @@ cv::Mat VectorMedianFilter(const cv::Mat &img, const int window=5);
  *      input image
  * @param window
  *      filtering window size
+ * @param metric
+ *      the distance used to compare colours
  * @return
  *      output edge map
  */
-cv::Mat VectorRangeFilter(const cv::Mat &img, const int window=5);
+cv::Mat VectorRangeFilter(const cv::Mat &img, const int window=5,
+                          const DistanceMetric metric=kEuclidean);
+
+/**
+ * @brief The Vector Range filter.
+ * @param img
+ *      input image
+ * @param out
+ *      output edge map; reused if it already has the correct size and type
+ * @param workspace
+ *      reusable intermediate buffers
+ * @param window
+ *      filtering window size
+ * @param metric
+ *      the distance used to compare colours
+ */
+void VectorRangeFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                       const int window=5,
+                       const DistanceMetric metric=kEuclidean);
 
 /**
  * @brief The Minimum Vector Dispersion filter.
@@ -54,27 +258,90 @@ cv::Mat VectorRangeFilter(const cv::Mat &img, const int window=5);
  *      detection
  * @param window
  *      filtering window size
+ * @param metric
+ *      the distance used to compare colours
  * @return
  *      output edge map
  */
 cv::Mat MinimumVectorDispersionFilter(const cv::Mat &img, const int k=3,
-                                      const int l=4, const int window=5);
+                                      const int l=4, const int window=5,
+                                      const DistanceMetric metric=kEuclidean);
+
+/**
+ * @brief The Minimum Vector Dispersion filter.
+ * @param img
+ *      input image
+ * @param out
+ *      output edge map; reused if it already has the correct size and type
+ * @param workspace
+ *      reusable intermediate buffers
+ * @param k, l
+ *      the two parameters used to control between noise suppression and edge
+ *      detection
+ * @param window
+ *      filtering window size
+ * @param metric
+ *      the distance used to compare colours
+ */
+void MinimumVectorDispersionFilter(const cv::Mat &img, cv::Mat &out,
+                                   Workspace &workspace, const int k=3,
+                                   const int l=4, const int window=5,
+                                   const DistanceMetric metric=kEuclidean);
 
 /**
+ * The image is blurred and the gradient computed a strip at a time, so the
+ * blurred image is never stored in full.  Sigmas above 3 use a cascade of box
+ * filters, which approximates the Gaussian at a constant cost per pixel.
+ *
  * @brief Compute colour edge gradients.
  * @param img
  *      input image
  * @param sigma
  *      the sigma of a Gaussian pre-filter
  * @param mode
- *      the gradient output mode
+ *      the gradient output mode; kToHSV always outputs an 8-bit image, even
+ *      for a 16-bit input
+ * @param metric
+ *      the distance used to compare colours
  * @return
- *      colour gradient image
+ *      colour gradient image; its type depends on the mode and the input
+ *      depth (see GradientMode)
  */
 cv::Mat ColourVectorGradientFilter(const cv::Mat &img, const double sigma=0,
-                                   const GradientMode mode=kToHSV);
+                                   const GradientMode mode=kToHSV,
+                                   const DistanceMetric metric=kEuclidean);
+
+/**
+ * @brief Compute colour edge gradients.
+ * @param img
+ *      input image
+ * @param out
+ *      colour gradient image; reused if it already has the correct size and
+ *      type
+ * @param workspace
+ *      reusable intermediate buffers
+ * @param sigma
+ *      the sigma of a Gaussian pre-filter
+ * @param mode
+ *      the gradient output mode; kToHSV always outputs an 8-bit image, even
+ *      for a 16-bit input
+ * @param metric
+ *      the distance used to compare colours
+ */
+void ColourVectorGradientFilter(const cv::Mat &img, cv::Mat &out,
+                                Workspace &workspace, const double sigma=0,
+                                const GradientMode mode=kToHSV,
+                                const DistanceMetric metric=kEuclidean);
 
 /**
+ * The Gaussian pre-filter is fused with the gradient, non-maximum suppression
+ * and thresholding into a single strip-based pass.  As with
+ * ColourVectorGradientFilter(), sigmas above 3 use a box-filter approximation.
+ *
+ * The edge map is always a CV_8UC1 image.  The thresholds are measured in
+ * the units of the input image, so they need to be 257 times larger for a
+ * 16-bit image than for the same 8-bit image (see DistanceMetric).
+ *
  * @brief Perform Canny-style edge detection using colour gradients.
  * @param img
  *      input image
@@ -82,10 +349,402 @@ cv::Mat ColourVectorGradientFilter(const cv::Mat &img, const double sigma=0,
  *      the lower and upper Canny hysteresis thresholds
  * @param sigma
  *      pre-blurring amount
+ * @param metric
+ *      the distance used to compare colours
+ * @param stats
+ *      if provided, receives the timings and counters for each stage
  */
 cv::Mat ColourCannyEdgeDetect(const cv::Mat &img,
                               const double t1, const double t2,
-                              const double sigma=3.0);
+                              const double sigma=3.0,
+                              const DistanceMetric metric=kEuclidean,
+                              Stats *stats=nullptr);
+
+/**
+ * @brief Perform Canny-style edge detection using colour gradients.
+ * @param img
+ *      input image
+ * @param out
+ *      output edge map; reused if it already has the correct size and type
+ * @param workspace
+ *      reusable intermediate buffers
+ * @param t1, t2
+ *      the lower and upper Canny hysteresis thresholds
+ * @param sigma
+ *      pre-blurring amount
+ * @param metric
+ *      the distance used to compare colours
+ * @param stats
+ *      if provided, receives the timings and counters for each stage
+ */
+void ColourCannyEdgeDetect(const cv::Mat &img, cv::Mat &out,
+                           Workspace &workspace,
+                           const double t1, const double t2,
+                           const double sigma=3.0,
+                           const DistanceMetric metric=kEuclidean,
+                           Stats *stats=nullptr);
+
+/**
+ * @brief The filters that can be described by a FilterSpec.
+ */
+enum FilterType
+{
+    kVectorMedian,              ///< VectorMedianFilter()
+    kVectorRange,               ///< VectorRangeFilter()
+    kMinimumVectorDispersion,   ///< MinimumVectorDispersionFilter()
+    kColourGradient,            ///< ColourVectorGradientFilter()
+    kCannyEdges                 ///< ColourCannyEdgeDetect()
+};
+
+/**
+ * A FilterSpec bundles a filter together with its parameters so that it can
+ * be passed around, e.g. to the strip-based processing functions.  Only the
+ * parameters used by the chosen filter are looked at.  The static factory
+ * functions mirror the filtering functions and use the same defaults.
+ *
+ * @brief Description of a filter and its parameters.
+ */
+struct FilterSpec
+{
+    FilterType type = kVectorMedian;    ///< the filter being applied
+    int window = 5;                     ///< filtering window size
+    int k = 3;                          ///< MVDF 'k' parameter
+    int l = 4;                          ///< MVDF 'l' parameter
+    MedianSearch search = kSearchAuto;  ///< vector median search strategy
+    double sigma = 0;                   ///< pre-blurring amount
+    GradientMode mode = kToHSV;         ///< gradient output mode
+    double t1 = 10;                     ///< lower Canny threshold
+    double t2 = 20;                     ///< upper Canny threshold
+    DistanceMetric metric = kEuclidean; ///< distance used to compare colours
+
+    /**
+     * @brief Describe a VectorMedianFilter().
+     */
+    static FilterSpec VectorMedian(const int window=5,
+                                   const MedianSearch search=kSearchAuto,
+                                   const DistanceMetric metric=kEuclidean);
+
+    /**
+     * @brief Describe a VectorRangeFilter().
+     */
+    static FilterSpec VectorRange(const int window=5,
+                                  const DistanceMetric metric=kEuclidean);
+
+    /**
+     * @brief Describe a MinimumVectorDispersionFilter().
+     */
+    static FilterSpec MinimumVectorDispersion(
+        const int k=3, const int l=4, const int window=5,
+        const DistanceMetric metric=kEuclidean);
+
+    /**
+     * @brief Describe a ColourVectorGradientFilter().
+     */
+    static FilterSpec ColourGradient(const double sigma=0,
+                                     const GradientMode mode=kToHSV,
+                                     const DistanceMetric metric=kEuclidean);
+
+    /**
+     * @brief Describe a ColourCannyEdgeDetect().
+     */
+    static FilterSpec CannyEdges(const double t1, const double t2,
+                                 const double sigma=3.0,
+                                 const DistanceMetric metric=kEuclidean);
+};
+
+/**
+ * @brief Apply the filter described by a FilterSpec.
+ * @param img
+ *      input image
+ * @param spec
+ *      the filter and its parameters
+ * @return
+ *      the filter output
+ */
+cv::Mat ApplyFilter(const cv::Mat &img, const FilterSpec &spec);
+
+/**
+ * @brief Apply the filter described by a FilterSpec.
+ * @param img
+ *      input image
+ * @param out
+ *      filter output; reused if it already has the correct size and type
+ * @param workspace
+ *      reusable intermediate buffers
+ * @param spec
+ *      the filter and its parameters
+ */
+void ApplyFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                 const FilterSpec &spec);
+
+/**
+ * The halo is the number of rows above and below an output row that the
+ * filter reads.  It is half of the window for the vector order-statistic
+ * filters.  The gradient needs one row, plus the radius of the Gaussian
+ * pre-filter, while the Canny detector needs one more row for the non-maximum
+ * suppression.  The Gaussian kernel is wider for 16-bit images than for 8-bit
+ * ones, so the halo depends on the image depth.
+ *
+ * @brief The number of rows of context that a filter needs.
+ * @param spec
+ *      the filter and its parameters
+ * @param depth
+ *      the depth of the image being filtered, i.e. `img.depth()`
+ */
+int FilterHalo(const FilterSpec &spec, const int depth=CV_8U);
+
+/**
+ * Only the pixels inside the region are computed and written into `out`.  If
+ * `out` already has the right size and type, the rest of it is left
+ * untouched; otherwise it's reallocated and the rest is set to zero.  The
+ * filter reads the real pixels around the region, up to its halo (see
+ * FilterHalo()), so the output is the same as the corresponding part of
+ * filtering the whole image.
+ *
+ * The one exception is the Canny detector, whose output inside a region is
+ * *not* guaranteed to match the full image.  Its hysteresis only follows weak
+ * edges within the region and its halo, so a weak edge that is only connected
+ * to a strong edge outside of them is dropped.  For exact edges, either
+ * filter the whole image or use a VideoEdgeDetector, which follows the edges
+ * across region boundaries.
+ *
+ * The input isn't copied; the filter reads a view of the region and its halo.
+ * The result goes into a buffer in the workspace and is then copied into
+ * `out`, so the cost is proportional to the region's area rather than the
+ * image's.  The workspace images are only grown to fit the largest region (or
+ * image) seen so far, and regions that fit reuse them.
+ *
+ * @brief Apply the filter described by a FilterSpec onto part of an image.
+ * @param img
+ *      input image
+ * @param out
+ *      filter output; allocated to the size of the input image if it doesn't
+ *      already have the right size and type
+ * @param workspace
+ *      reusable intermediate buffers
+ * @param spec
+ *      the filter and its parameters
+ * @param region
+ *      the region being filtered; clipped to the image
+ */
+void ApplyFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                 const FilterSpec &spec, const cv::Rect &region);
+
+/**
+ * Each region is filtered separately, exactly as if it was passed on its own,
+ * and the regions are written into `out` in order.  The same exception holds
+ * for the Canny detector: edges aren't followed from one region into another,
+ * even if the regions overlap or touch.
+ *
+ * @brief Apply the filter described by a FilterSpec onto parts of an image.
+ * @param img
+ *      input image
+ * @param out
+ *      filter output; allocated to the size of the input image if it doesn't
+ *      already have the right size and type
+ * @param workspace
+ *      reusable intermediate buffers
+ * @param spec
+ *      the filter and its parameters
+ * @param regions
+ *      the regions being filtered; each is clipped to the image
+ */
+void ApplyFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                 const FilterSpec &spec, const std::vector<cv::Rect> &regions);
+
+/**
+ * Called as `source(y, rows)`, where `rows` has already been allocated with
+ * the width of the full image and the type given to FilterStrips().  The
+ * source must fill it with the image rows starting at row `y`.  The rows are
+ * always requested in order and each row is only requested once.
+ *
+ * @brief Supplies the rows of an image that is processed in strips.
+ */
+typedef std::function<void(const int y, cv::Mat &rows)> RowSource;
+
+/**
+ * Called as `sink(y, rows)` with the filter output for the rows starting at
+ * row `y`.  The rows are always delivered in order.  The `rows` image is only
+ * valid for the duration of the call.
+ *
+ * @brief Receives the rows of a filtered image that is processed in strips.
+ */
+typedef std::function<void(const int y, const cv::Mat &rows)> RowSink;
+
+/**
+ * The image is read from the source and filtered in horizontal strips, so that
+ * it never has to be in memory all at once.  Each strip is padded with the
+ * rows the filter needs above and below it (see FilterHalo()); those are kept
+ * from the previous strip rather than being read twice.  The peak memory use
+ * is proportional to `(strip_rows + 2*halo)*size.width`.
+ *
+ * The output is identical to filtering the whole image, except for the Canny
+ * detector, whose output is *not* guaranteed to match.  Its hysteresis step
+ * follows weak edges across the entire image, so in strip mode a weak edge is
+ * only kept if it's connected to a strong edge within the strip or its halo.
+ * The edges found in strips are always a subset of the exact ones.  For exact
+ * edges, make the strip at least as tall as the image.
+ *
+ * @brief Apply a filter onto an image one strip at a time.
+ * @param spec
+ *      the filter and its parameters
+ * @param size
+ *      the size of the full image
+ * @param source
+ *      supplies the input image rows
+ * @param sink
+ *      receives the filtered rows
+ * @param strip_rows
+ *      the number of output rows in each strip
+ * @param type
+ *      the type of the input rows, either CV_8UC3 or CV_16UC3
+ * @throws std::runtime_error
+ *      if the strip size isn't positive or the type isn't supported
+ */
+void FilterStrips(const FilterSpec &spec, const cv::Size &size,
+                  const RowSource &source, const RowSink &sink,
+                  const int strip_rows=256, const int type=CV_8UC3);
+
+/**
+ * @brief Create a row source that reads from an in-memory image.
+ * @param img
+ *      the source image; must outlive the returned source
+ */
+RowSource ImageRowSource(const cv::Mat &img);
+
+/**
+ * @brief Create a row sink that writes into an in-memory image.
+ * @param img
+ *      the destination image; allocated on the first call to the sink and
+ *      must outlive the returned sink
+ * @param size
+ *      the size of the full image
+ */
+RowSink ImageRowSink(cv::Mat &img, const cv::Size &size);
+
+/**
+ * @brief Supplies the image at some position in a batch.
+ */
+typedef std::function<cv::Mat(const size_t index)> BatchSource;
+
+/**
+ * @brief Receives the filtered image at some position in a batch.
+ */
+typedef std::function<void(const size_t index, const cv::Mat &out)> BatchSink;
+
+/**
+ * The images are filtered concurrently, with each one being a task in a
+ * single TBB task arena.  The filters split each image into tasks of their
+ * own, so a batch of small images keeps all of the workers busy while a large
+ * image is still spread across them.
+ *
+ * @brief Apply a filter onto a batch of images.
+ * @param images
+ *      the input images
+ * @param spec
+ *      the filter and its parameters
+ * @param num_threads
+ *      the maximum number of threads to use; '0' uses all available threads
+ * @return
+ *      the filtered images, in the same order as the inputs; an empty input
+ *      produces an empty output
+ * @throws std::runtime_error
+ *      if the number of threads is negative
+ */
+std::vector<cv::Mat> ProcessBatch(const std::vector<cv::Mat> &images,
+                                  const FilterSpec &spec,
+                                  const int num_threads=0);
+
+/**
+ * This is the streaming version of ProcessBatch().  Each image is requested
+ * from the source right before it's filtered and handed to the sink right
+ * after, so decoding and encoding happen alongside the filtering of the other
+ * images and only a few images are held in memory at once.  The source and
+ * sink are called concurrently, from multiple threads, and in no particular
+ * order.  The source can skip an image, e.g. one that couldn't be read, by
+ * returning an empty image; the sink isn't called for it.
+ *
+ * @brief Apply a filter onto a batch of images from a source.
+ * @param count
+ *      the number of images in the batch
+ * @param spec
+ *      the filter and its parameters
+ * @param source
+ *      supplies the input images
+ * @param sink
+ *      receives the filtered images
+ * @param num_threads
+ *      the maximum number of threads to use; '0' uses all available threads
+ * @throws std::runtime_error
+ *      if the number of threads is negative
+ */
+void ProcessBatch(const size_t count, const FilterSpec &spec,
+                  const BatchSource &source, const BatchSink &sink,
+                  const int num_threads=0);
+
+/**
+ * The detector keeps the previous frame along with its intermediate results.
+ * Each new frame is compared against the previous one in 32x32 tiles, and the
+ * blurring, gradient, non-maximum suppression and thresholding are only redone
+ * for the tiles that changed, plus enough of a halo to cover the Gaussian
+ * kernel and the gradient.  The hysteresis is then only redone for the edge
+ * chains that pass through the updated tiles.  A frame with a large change,
+ * or with a different size or type, is processed from scratch instead.
+ *
+ * The output is identical to calling ColourCannyEdgeDetect() on each frame.
+ *
+ * @brief Canny edge detector for video where most of each frame is static.
+ */
+class VideoEdgeDetector
+{
+public:
+    /**
+     * @brief Create a new detector.
+     * @param t1
+     *      the lower hysteresis threshold
+     * @param t2
+     *      the upper hysteresis threshold
+     * @param sigma
+     *      standard deviation of the Gaussian pre-filter; disabled if '0'
+     * @param metric
+     *      the distance metric used to compute the colour gradients
+     */
+    VideoEdgeDetector(const double t1, const double t2,
+                      const double sigma=3.0,
+                      const DistanceMetric metric=kEuclidean);
+
+    /**
+     * @brief Detect the edges in the next frame.
+     * @param frame
+     *      CV_8UC3 or CV_16UC3 input frame
+     * @return
+     *      the CV_8UC1 edge image; it is only valid until the next call
+     * @throws std::runtime_error
+     *      if the frame isn't an 8-bit or 16-bit, three channel image
+     */
+    const cv::Mat &Detect(const cv::Mat &frame);
+
+    /**
+     * @brief Forget the previous frame so that the next one is processed
+     *      from scratch.
+     */
+    void Reset();
+
+private:
+    void DetectFull();
+    void UpdateClasses(const cv::Rect &region);
+    void UpdateEdges(const std::vector<cv::Rect> &regions);
+
+    double t1_, t2_, sigma_;
+    DistanceMetric metric_;
+
+    cv::Mat frame_;     ///< the previous frame
+    cv::Mat blurred_;   ///< the pre-filtered frame
+    cv::Mat classes_;   ///< the edge classes before hysteresis
+    cv::Mat edges_;     ///< the final edges
+    cv::Mat labels_;    ///< marks the pixels visited by the hysteresis
+    int stamp_;
+};
 
 } // namespace chromavec
 
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+
+#include <opencv2/core.hpp>
+
+#include <tbb/task_arena.h>
+
+#include <chromavec/chromavec.h>
+
+#include "filters/canny-edges.h"
+#include "filters/minimum-vector-dispersion.h"
+#include "filters/vector-range.h"
+#include "filters/vmf.h"
+#include "utilities/distances.h"
+#include "utilities/filter.h"
+
+#include "validators.h"
+
+// Internal Functions
+namespace {
+
+using namespace chromavec::internal;
+
+/**
+ * @brief Canny thresholds used by the edge detection benchmarks.
+ */
+constexpr double kLowThreshold = 10;
+constexpr double kHighThreshold = 30;
+
+/**
+ * @brief Gaussian sigma used by the gradient-based benchmarks.
+ */
+constexpr double kSigma = 1.5;
+
+/**
+ * @brief Define the benchmark options.
+ */
+struct Options
+{
+    std::vector<cv::Size> sizes;
+    std::vector<int> windows;
+    std::vector<int> threads;
+    int repeats;
+    std::string output;
+
+    /**
+     * @brief Constructor
+     * @param quick
+     *      only run a small matrix, e.g. as a smoke test
+     */
+    Options(const bool quick)
+        : repeats(quick ? 3 : 7),
+          output()
+    {
+        if (quick)
+        {
+            this->sizes = {cv::Size(320, 240)};
+            this->windows = {3, 5};
+        }
+        else
+        {
+            this->sizes = {cv::Size(320, 240), cv::Size(1280, 720),
+                           cv::Size(1920, 1080)};
+            this->windows = {3, 5, 7, 9, 15};
+        }
+
+        // Powers of two up to the number of hardware threads, plus the
+        // hardware thread count itself.
+        const int max_threads =
+            std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+        for (int n = 1; n < max_threads; n *= 2)
+            this->threads.push_back(n);
+        this->threads.push_back(max_threads);
+    }
+};
+
+/**
+ * @brief The inputs shared by all of the benchmarks for one image size.
+ */
+struct Inputs
+{
+    cv::Mat image;      ///< CV_8UC3 test image
+    cv::Mat image16;    ///< the test image scaled up to CV_16UC3
+    cv::Mat gradient;   ///< ColourGradient output
+    cv::Mat nms;        ///< NonMaximumSupression output
+    cv::Mat classes;    ///< Threshold output
+};
+
+/**
+ * A benchmark is split into a setup, which isn't timed, and the work being
+ * measured.  The setup is needed by operators like Hysteresis that modify
+ * their input.
+ *
+ * @brief A single benchmark.
+ */
+struct Benchmark
+{
+    std::string name;
+    std::string kind;       ///< either "filter" or "operator"
+    bool uses_window;
+    std::function<void(const Inputs &, cv::Mat &)> setup;
+    std::function<void(const Inputs &, const int, cv::Mat &)> run;
+};
+
+/**
+ * @brief Generate a reproducible test image.
+ *
+ * The image has smooth colour ramps, so that there are regions with few
+ * colours, along with hard-edged blocks and some noise.
+ */
+cv::Mat GenerateImage(const cv::Size &size)
+{
+    std::mt19937 rng(size.area());
+    std::uniform_int_distribution<int> noise(-12, 12);
+
+    cv::Mat img(size, CV_8UC3);
+    for (int y = 0; y < size.height; y++)
+    {
+        uint8_t *row = img.ptr<uint8_t>(y);
+        for (int x = 0; x < size.width; x++)
+        {
+            const bool block = ((x / 37) + (y / 29)) % 3 == 0;
+            const int r = (255*x) / size.width;
+            const int g = (255*y) / size.height;
+            const int b = block ? 220 : 40;
+
+            row[3*x + 0] = cv::saturate_cast<uint8_t>(b + noise(rng));
+            row[3*x + 1] = cv::saturate_cast<uint8_t>(g + noise(rng));
+            row[3*x + 2] = cv::saturate_cast<uint8_t>(r + noise(rng));
+        }
+    }
+
+    return img;
+}
+
+/**
+ * @brief Apply an operator onto an image with the library's tiled driver.
+ */
+template<typename Operator, typename ...Args>
+void RunOperator(const cv::Mat &img, cv::Mat &out, Args &&...args)
+{
+    out.create(img.rows, img.cols, Operator::output_type);
+    // The tile buffers and operators are reused between runs, like a
+    // Workspace would be, so the timings don't include allocating them.
+    static TileBuffers buffers;
+    static OperatorCache operators;
+    FilterTiles<Operator>(out, img, TileLayout(), buffers, operators,
+                          std::forward<Args>(args)...);
+}
+
+Inputs PrepareInputs(const cv::Size &size)
+{
+    Inputs inputs;
+    inputs.image = GenerateImage(size);
+    inputs.image.convertTo(inputs.image16, CV_16U, 257);
+    RunOperator<ColourGradient<>>(inputs.image, inputs.gradient);
+    RunOperator<NonMaximumSupression<>>(inputs.gradient, inputs.nms);
+    RunOperator<Threshold<>>(inputs.nms, inputs.classes,
+                             static_cast<float>(kLowThreshold),
+                             static_cast<float>(kHighThreshold));
+    return inputs;
+}
+
+std::vector<Benchmark> DefineBenchmarks()
+{
+    typedef SquaredEuclideanDistance Distance;
+    const auto no_setup = [](const Inputs &, cv::Mat &) {};
+
+    return {
+        // Public filtering functions.
+        {"VectorMedianFilter", "filter", true, no_setup,
+         [](const Inputs &in, const int window, cv::Mat &out)
+         {
+             out = chromavec::VectorMedianFilter(in.image, window);
+         }},
+        {"VectorRangeFilter", "filter", true, no_setup,
+         [](const Inputs &in, const int window, cv::Mat &out)
+         {
+             out = chromavec::VectorRangeFilter(in.image, window);
+         }},
+        {"MinimumVectorDispersionFilter", "filter", true, no_setup,
+         [](const Inputs &in, const int window, cv::Mat &out)
+         {
+             out = chromavec::MinimumVectorDispersionFilter(in.image, 3, 4,
+                                                            window);
+         }},
+        {"ColourVectorGradientFilter", "filter", false, no_setup,
+         [](const Inputs &in, const int, cv::Mat &out)
+         {
+             out = chromavec::ColourVectorGradientFilter(in.image, kSigma);
+         }},
+        {"ColourCannyEdgeDetect", "filter", false, no_setup,
+         [](const Inputs &in, const int, cv::Mat &out)
+         {
+             out = chromavec::ColourCannyEdgeDetect(in.image, kLowThreshold,
+                                                    kHighThreshold, kSigma);
+         }},
+        {"VectorMedianFilter16U", "filter", true, no_setup,
+         [](const Inputs &in, const int window, cv::Mat &out)
+         {
+             out = chromavec::VectorMedianFilter(in.image16, window);
+         }},
+        {"ColourCannyEdgeDetect16U", "filter", false, no_setup,
+         [](const Inputs &in, const int, cv::Mat &out)
+         {
+             out = chromavec::ColourCannyEdgeDetect(in.image16,
+                                                    257*kLowThreshold,
+                                                    257*kHighThreshold, kSigma);
+         }},
+
+        // Internal operators.
+        {"ColourGradient", "operator", false, no_setup,
+         [](const Inputs &in, const int, cv::Mat &out)
+         {
+             RunOperator<ColourGradient<Distance>>(in.image, out);
+         }},
+        {"NonMaximumSupression", "operator", false, no_setup,
+         [](const Inputs &in, const int, cv::Mat &out)
+         {
+             RunOperator<NonMaximumSupression<>>(in.gradient, out);
+         }},
+        {"Threshold", "operator", false, no_setup,
+         [](const Inputs &in, const int, cv::Mat &out)
+         {
+             RunOperator<Threshold<>>(in.nms, out,
+                                      static_cast<float>(kLowThreshold),
+                                      static_cast<float>(kHighThreshold));
+         }},
+        {"CannyEdgeClasses", "operator", false, no_setup,
+         [](const Inputs &in, const int, cv::Mat &out)
+         {
+             static StripBuffers strips, rings;
+             CannyEdgeClasses<Distance>(in.image, out, kSigma, kLowThreshold,
+                                        kHighThreshold, strips, rings);
+         }},
+        {"Hysteresis", "operator", false,
+         [](const Inputs &in, cv::Mat &out) { in.classes.copyTo(out); },
+         [](const Inputs &, const int, cv::Mat &out)
+         {
+             static FloodStacks stacks;
+             Hysteresis(out, stacks);
+         }},
+        {"VMFilter", "operator", true, no_setup,
+         [](const Inputs &in, const int window, cv::Mat &out)
+         {
+             RunOperator<VMFilter<Distance>>(in.image, out, window);
+         }},
+        {"HistogramVMFilter", "operator", true, no_setup,
+         [](const Inputs &in, const int window, cv::Mat &out)
+         {
+             RunOperator<HistogramVMFilter>(in.image, out, window);
+         }},
+        {"VectorRangeFilter", "operator", true, no_setup,
+         [](const Inputs &in, const int window, cv::Mat &out)
+         {
+             RunOperator<VectorRangeFilter<Distance>>(in.image, out, window);
+         }},
+        {"MinVecDispersionFilter", "operator", true, no_setup,
+         [](const Inputs &in, const int window, cv::Mat &out)
+         {
+             RunOperator<MinVecDispersionFilter<Distance>>(in.image, out,
+                                                           window, 3, 4);
+         }},
+    };
+}
+
+/**
+ * @brief Time a benchmark.
+ * @return
+ *      the median run time, in seconds
+ */
+double TimeBenchmark(const Benchmark &bench, const Inputs &inputs,
+                     const int window, const int threads, const int repeats)
+{
+    tbb::task_arena arena(threads);
+    std::vector<double> times;
+    cv::Mat out;
+
+    // The first run is a warm-up and isn't counted.
+    for (int i = 0; i <= repeats; i++)
+    {
+        bench.setup(inputs, out);
+        const auto start = std::chrono::steady_clock::now();
+        arena.execute([&]() { bench.run(inputs, window, out); });
+        const auto end = std::chrono::steady_clock::now();
+
+        if (i > 0)
+            times.push_back(std::chrono::duration<double>(end - start).count());
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size()/2,
+                     times.end());
+    return times[times.size()/2];
+}
+
+} // end of anonymous namespace
+
+int main(int nargs, char **args)
+{
+    bool quick = false;
+    int repeats = 0;
+    std::string output;
+    std::string only;
+
+    CLI::App app("Benchmark the chromavec filters and write the results as "
+                 "JSON.");
+    app.add_flag("--quick", quick, "Only run a small matrix, e.g. as a smoke "
+                 "test.");
+    app.add_option("--repeats", repeats,
+                   "Number of timed runs for each benchmark.")
+       ->check(cliutils::MinValue(1));
+    app.add_option("--filter", only, "Only run the benchmark with this name.");
+    app.add_option("--output", output,
+                   "File the results are written to, instead of stdout.");
+    CLI11_PARSE(app, nargs, args);
+
+    Options options(quick);
+    if (repeats > 0)
+        options.repeats = repeats;
+
+    std::ofstream file;
+    if (!output.empty())
+    {
+        file.open(output);
+        if (!file)
+            throw std::runtime_error("Could not open '" + output + "'.");
+    }
+    std::ostream &json = output.empty() ? std::cout : file;
+
+    json << "{\n"
+         << "  \"version\": \"" << chromavec::Version::ToString() << "\",\n"
+         << "  \"hardware_threads\": " << std::thread::hardware_concurrency()
+         << ",\n"
+         << "  \"repeats\": " << options.repeats << ",\n"
+         << "  \"results\": [";
+
+    bool first = true;
+    for (const cv::Size &size : options.sizes)
+    {
+        const Inputs inputs = PrepareInputs(size);
+        const double pixels = size.area();
+
+        for (const Benchmark &bench : DefineBenchmarks())
+        {
+            if (!only.empty() && bench.name != only)
+                continue;
+
+            const std::vector<int> windows =
+                bench.uses_window ? options.windows : std::vector<int>{0};
+
+            for (const int window : windows)
+            {
+                double single_thread = 0;
+                for (const int threads : options.threads)
+                {
+                    const double seconds = TimeBenchmark(bench, inputs, window,
+                                                         threads,
+                                                         options.repeats);
+                    if (threads == 1)
+                        single_thread = seconds;
+
+                    const double efficiency = single_thread / (seconds*threads);
+
+                    json << (first ? "\n" : ",\n")
+                         << "    {\"name\": \"" << bench.name << "\", "
+                         << "\"kind\": \"" << bench.kind << "\", "
+                         << "\"width\": " << size.width << ", "
+                         << "\"height\": " << size.height << ", "
+                         << "\"window\": " << window << ", "
+                         << "\"threads\": " << threads << ", "
+                         << "\"seconds\": " << seconds << ", "
+                         << "\"ns_per_pixel\": " << 1e9*seconds / pixels << ", "
+                         << "\"mpixels_per_second\": "
+                         << pixels / (1e6*seconds) << ", "
+                         << "\"scaling_efficiency\": " << efficiency << "}";
+                    first = false;
+
+                    std::cerr << bench.name << " " << size.width << "x"
+                              << size.height << " w=" << window
+                              << " t=" << threads << ": "
+                              << 1e9*seconds / pixels << " ns/px\n";
+                }
+            }
+        }
+    }
+
+    json << "\n  ]\n}\n";
+    return 0;
+}
@@ -11,33 +11,13 @@
 
 #include <chromavec/chromavec.h>
 
+#include "batch-io.h"
+#include "validators.h"
+
 // Internal Functions
 namespace {
 
-/**
- * @brief CLI11 validator to check that a value is greater than some minimum.
- *
- * This is a modified version of the CLI::Range validator.
- */
-struct MinValue : public CLI::Validator
-{
-    template<typename T>MinValue(const T value)
-    {
-        std::stringstream out;
-        out << CLI::detail::type_name<T>() << " >= " << value;
-
-        tname = out.str();
-        func = [value](std::string input) -> std::string
-        {
-            T val;
-            CLI::detail::lexical_cast(input, val);
-            if (val < value)
-                return "Value " + input + " must be larger than " + std::to_string(value);
-
-            return std::string();
-        };
-    }
-};
+using cliutils::MinValue;
 
 /**
  * @brief Define the application options.
@@ -46,6 +26,8 @@ struct Options
 {
     std::string input, output;
     bool verbose;
+    bool is_list;
+    int threads;
     CLI::App app;
 
     /**
@@ -57,6 +39,8 @@ struct Options
         : input(),
           output(),
           verbose(false),
+          is_list(false),
+          threads(0),
           app(desc)
     {
         app.require_subcommand(1);
@@ -73,11 +57,18 @@ struct Options
     CLI::App *AddSubcommand(const std::string &cmd, const std::string &desc)
     {
         CLI::App *subcmd = this->app.add_subcommand(cmd, desc);
-        subcmd->add_option("input", this->input, "Input image")
-              ->check(CLI::ExistingFile)
+        subcmd->add_option("input", this->input,
+                           "Input image, or a directory of images")
+              ->check(CLI::ExistingPath)
               ->required();
-        subcmd->add_option("output", this->output, "Output image")
+        subcmd->add_option("output", this->output,
+                           "Output image, or a directory for a batch")
               ->required();
+        subcmd->add_flag("-l, --list", this->is_list,
+                         "Input is a text file listing the images to filter.");
+        subcmd->add_option("-j, --threads", this->threads,
+                           "Maximum number of threads used for a batch.")
+              ->check(MinValue(1));
         return subcmd;
     }
 };
@@ -101,24 +92,42 @@ struct MVDFOptions
 };
 
 /**
- * @brief Wraps a filter call to help with the CLI11 callbacks.
+ * @brief Apply a filter onto the input image and save the result.
+ * @return
+ *      false if any of the images in a batch couldn't be processed
  */
-template<typename Filter, typename ...Args>
-void RunFilter(Filter filter, const Options &options, const std::string &name,
-               Args &&...args)
+bool RunFilter(const chromavec::FilterSpec &spec, const Options &options,
+               const std::string &name)
 {
     if (options.verbose)
         std::cout << "Filter: " << name << "\n";
 
+    const std::vector<std::string> batch = batchio::FindBatch(options.input,
+                                                              options.is_list);
+    if (!batch.empty())
+    {
+        CLI::Timer timer;
+        const size_t failures = batchio::RunBatch(spec, batch, options.output,
+                                                  options.threads);
+
+        if (options.verbose)
+            std::cout << "Filtered " << batch.size() - failures << " of "
+                      << batch.size() << " images.\n"
+                      << timer.to_string() << "\n";
+        return failures == 0;
+    }
+
     cv::Mat img = cv::imread(options.input);
     cv::Mat out;
     {
         CLI::Timer timer;
-        out = filter(img, std::forward<Args>(args)...);
+        out = chromavec::ApplyFilter(img, spec);
+
         if (options.verbose)
             std::cout << timer.to_string() << "\n";
     }
     cv::imwrite(options.output, out);
+    return true;
 }
 
 } // end of anonymous namespace
@@ -146,6 +155,9 @@ int main(int nargs, char **args)
     double sigma = 0.0;
     bool just_mag = false;
 
+    // Cleared by the subcommands if any of the images couldn't be processed.
+    bool succeeded = true;
+
     // Define Minimum Vector Dispersion Filter.
     {
         auto mvdf = options.AddSubcommand("mvdf",
@@ -162,8 +174,10 @@ int main(int nargs, char **args)
         mvdf->callback([&]()
         {
             std::cout << "w: " << window << " k: " << k << " l: " << l << "\n";
-            RunFilter(chromavec::MinimumVectorDispersionFilter, options,
-                      "Minimum Vector Dispersion", k, l, window);
+            succeeded = RunFilter(
+                chromavec::FilterSpec::MinimumVectorDispersion(k, l, window),
+                options, "Minimum Vector Dispersion"
+            );
         });
     }
 
@@ -175,8 +189,8 @@ int main(int nargs, char **args)
 
         vr->callback([&]()
         {
-            RunFilter(chromavec::VectorRangeFilter, options, "Vector Range",
-                      window);
+            succeeded = RunFilter(chromavec::FilterSpec::VectorRange(window),
+                                  options, "Vector Range");
         });
     }
 
@@ -190,8 +204,8 @@ int main(int nargs, char **args)
 
         vecmed->callback([&]()
         {
-            RunFilter(chromavec::VectorMedianFilter, options, "Vector Median",
-                      window);
+            succeeded = RunFilter(chromavec::FilterSpec::VectorMedian(window),
+                                  options, "Vector Median");
         });
     }
 
@@ -209,13 +223,15 @@ int main(int nargs, char **args)
             std::cout << "sigma: " << sigma << "\n";
             const chromavec::GradientMode mode =
                 just_mag ? chromavec::kMagnitudeOnly : chromavec::kToHSV;
-            RunFilter(chromavec::ColourVectorGradientFilter, options,
-                      "Vector Colour Gradient", sigma, mode);
+            succeeded = RunFilter(
+                chromavec::FilterSpec::ColourGradient(sigma, mode), options,
+                "Vector Colour Gradient"
+            );
         });
     }
 
     // Parsing will call the various callback that do the actual work.
     CLI11_PARSE(options.app, nargs, args);
 
-    return 0;
+    return succeeded ? 0 : 1;
 }
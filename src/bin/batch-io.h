@@ -0,0 +1,209 @@
+/**
+ * @file
+ * @brief Helpers for processing batches of images from the command line.
+ */
+#ifndef SRC_BIN_BATCH_IO_H_
+#define SRC_BIN_BATCH_IO_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <chromavec/chromavec.h>
+
+namespace batchio {
+
+/**
+ * @brief Check if a path is a directory.
+ */
+inline bool IsDirectory(const std::string &path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+/**
+ * @brief Check if a file has one of the common image extensions.
+ */
+inline bool IsImageFile(const std::string &path)
+{
+    static const std::vector<std::string> extensions{
+        ".bmp", ".jpeg", ".jpg", ".png", ".ppm", ".tif", ".tiff", ".webp"
+    };
+
+    const size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](const unsigned char c) { return std::tolower(c); });
+
+    return std::find(extensions.begin(), extensions.end(), ext) !=
+           extensions.end();
+}
+
+/**
+ * @brief Obtain the file name, without the directory, of a path.
+ */
+inline std::string FileName(const std::string &path)
+{
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/**
+ * The input is a batch if it's either a directory, in which case all of the
+ * images in it are processed, or a text file listing one image per line.
+ *
+ * @brief Find the images in a batch.
+ * @param input
+ *      the input path given on the command line
+ * @param is_list
+ *      if the input is a file list
+ * @return
+ *      the paths of the images, or an empty list if the input is just a
+ *      single image
+ * @throws std::runtime_error
+ *      if the file list can't be read
+ */
+inline std::vector<std::string> FindBatch(const std::string &input,
+                                          const bool is_list)
+{
+    std::vector<std::string> batch;
+
+    if (is_list)
+    {
+        std::ifstream list(input);
+        if (!list)
+            throw std::runtime_error("Could not open '" + input + "'.");
+
+        std::string line;
+        while (std::getline(list, line))
+        {
+            if (!line.empty())
+                batch.push_back(line);
+        }
+    }
+    else if (IsDirectory(input))
+    {
+        std::vector<cv::String> files;
+        cv::glob(input, files, false);
+        for (const cv::String &file : files)
+        {
+            if (IsImageFile(file))
+                batch.push_back(file);
+        }
+    }
+
+    return batch;
+}
+
+/**
+ * @brief Check that no two images in a batch would be saved under the same
+ *      output file name.
+ * @throws std::runtime_error
+ *      if two images have the same file name
+ */
+inline void CheckOutputNames(const std::vector<std::string> &batch)
+{
+    std::map<std::string, std::string> outputs;
+    for (const std::string &path : batch)
+    {
+        const auto inserted = outputs.emplace(FileName(path), path);
+        if (!inserted.second)
+        {
+            throw std::runtime_error("'" + inserted.first->second + "' and '" +
+                                     path + "' would both be saved as '" +
+                                     inserted.first->first + "'.");
+        }
+    }
+}
+
+/**
+ * Each image is decoded, filtered and then encoded as a single task so that
+ * the I/O for some images overlaps with the filtering of others.  The outputs
+ * are written into the output directory using the same file names as the
+ * inputs.  An image that can't be read or saved is reported on `stderr` and
+ * skipped without stopping the rest of the batch.
+ *
+ * @brief Filter a batch of images and save the results.
+ * @param spec
+ *      the filter and its parameters
+ * @param batch
+ *      the input images
+ * @param output_dir
+ *      directory where the filtered images are saved
+ * @param num_threads
+ *      the maximum number of threads to use; '0' uses all available threads
+ * @return
+ *      the number of images that couldn't be read or saved
+ * @throws std::runtime_error
+ *      if the output directory doesn't exist or if two images would be saved
+ *      under the same name
+ */
+inline size_t RunBatch(const chromavec::FilterSpec &spec,
+                       const std::vector<std::string> &batch,
+                       const std::string &output_dir, const int num_threads)
+{
+    if (!IsDirectory(output_dir))
+        throw std::runtime_error("Output must be an existing directory when "
+                                 "processing a batch.");
+
+    CheckOutputNames(batch);
+
+    // The messages are written in one go so that the ones from different
+    // threads don't get interleaved.
+    std::atomic<size_t> failures(0);
+    const auto report = [&failures](const std::string &message)
+    {
+        failures++;
+        std::cerr << message + "\n";
+    };
+
+    chromavec::ProcessBatch(
+        batch.size(), spec,
+        [&batch, &report](const size_t index)
+        {
+            cv::Mat img = cv::imread(batch[index]);
+            if (img.empty())
+                report("Could not read '" + batch[index] + "'.");
+            return img;
+        },
+        [&batch, &output_dir, &report](const size_t index, const cv::Mat &out)
+        {
+            const std::string path = output_dir + "/" + FileName(batch[index]);
+
+            bool saved = false;
+            try
+            {
+                saved = cv::imwrite(path, out);
+            }
+            catch (const cv::Exception &)
+            {
+                // e.g. the file extension isn't a known image format
+            }
+
+            if (!saved)
+                report("Could not save '" + path + "'.");
+        },
+        num_threads
+    );
+
+    return failures;
+}
+
+} // namespace batchio
+
+#endif // SRC_BIN_BATCH_IO_H_
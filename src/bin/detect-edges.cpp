@@ -10,6 +10,9 @@
 
 #include <chromavec/chromavec.h>
 
+#include "batch-io.h"
+#include "validators.h"
+
 // Internal Functions
 namespace {
 
@@ -17,14 +20,18 @@ struct Options
 {
     std::vector<double> th;
     double sigma;
+    int threads;
     bool verbose;
+    bool is_list;
     std::string input, output;
     CLI::App app;
 
     Options()
         : th{10, 20},
           sigma(1.5),
+          threads(0),
           verbose(false),
+          is_list(false),
           input(),
           output(),
           app("Canny-style Edge Detector")
@@ -34,12 +41,19 @@ struct Options
            ->expected(2);
 
         app.add_option("-s, --sigma", this->sigma, "Gaussian filter sigma.", true);
+        app.add_option("-j, --threads", this->threads,
+                       "Maximum number of threads used for a batch.")
+           ->check(cliutils::MinValue(1));
+        app.add_flag("-l, --list", this->is_list,
+                     "Input is a text file listing the images to process.");
         app.add_flag("-v, --verbose", this->verbose, "Show verbose output.");
 
-        app.add_option("image", this->input, "Input image.")
-           ->check(CLI::ExistingFile)
+        app.add_option("image", this->input,
+                       "Input image, or a directory of images.")
+           ->check(CLI::ExistingPath)
            ->required();
-        app.add_option("edges", this->output, "Output edge map.")
+        app.add_option("edges", this->output,
+                       "Output edge map, or a directory for a batch.")
            ->required();
     }
 };
@@ -55,6 +69,23 @@ std::ostream &operator<<(std::ostream &os, const Options &opts)
     return os;
 }
 
+std::ostream &operator<<(std::ostream &os, const chromavec::Stats &stats)
+{
+    os << "Stages:\n"
+       << "  Classes    - " << 1000*stats.classes_seconds << " ms\n"
+       << "  Counting   - " << 1000*stats.counting_seconds << " ms\n"
+       << "  Hysteresis - " << 1000*stats.hysteresis_seconds << " ms ("
+                            << stats.hysteresis_strips << " strips)\n"
+       << "  Output     - " << 1000*stats.output_seconds << " ms\n"
+       << "Pixels:\n"
+       << "  Strong     - " << stats.strong_pixels << "\n"
+       << "  Weak       - " << stats.weak_pixels << " ("
+                            << stats.promoted_pixels << " promoted)\n"
+       << "  None       - " << stats.none_pixels << "\n"
+       << "Tasks: " << stats.tasks << "\n";
+    return os;
+}
+
 } // end of anonymous namespace
 
 int main(int nargs, char **args)
@@ -69,14 +100,42 @@ int main(int nargs, char **args)
                   << options;
     }
 
+    const chromavec::FilterSpec spec =
+        chromavec::FilterSpec::CannyEdges(options.th[0], options.th[1],
+                                          options.sigma);
+
+    const std::vector<std::string> batch = batchio::FindBatch(options.input,
+                                                              options.is_list);
+    if (!batch.empty())
+    {
+        CLI::Timer timer;
+        const size_t failures = batchio::RunBatch(spec, batch, options.output,
+                                                  options.threads);
+
+        if (options.verbose)
+            std::cout << "Processed " << batch.size() - failures << " of "
+                      << batch.size() << " images.\n"
+                      << timer.to_string() << "\n";
+        return failures == 0 ? 0 : 1;
+    }
+
     cv::Mat img = cv::imread(options.input);
     cv::Mat out;
     {
         CLI::Timer timer;
-        out = chromavec::ColourCannyEdgeDetect(img,
-                                               options.th[0],
-                                               options.th[1],
-                                               options.sigma);
+        if (options.verbose)
+        {
+            chromavec::Stats stats;
+            out = chromavec::ColourCannyEdgeDetect(img, options.th[0],
+                                                   options.th[1], options.sigma,
+                                                   chromavec::kEuclidean,
+                                                   &stats);
+            std::cout << stats;
+        }
+        else
+        {
+            out = chromavec::ApplyFilter(img, spec);
+        }
 
         if (options.verbose)
             std::cout << timer.to_string() << "\n";
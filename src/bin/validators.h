@@ -0,0 +1,42 @@
+/**
+ * @file
+ * @brief CLI11 validators shared by the command line tools.
+ */
+#ifndef SRC_BIN_VALIDATORS_H_
+#define SRC_BIN_VALIDATORS_H_
+
+#include <sstream>
+#include <string>
+
+#include <CLI/CLI.hpp>
+
+namespace cliutils {
+
+/**
+ * @brief CLI11 validator to check that a value is greater than some minimum.
+ *
+ * This is a modified version of the CLI::Range validator.
+ */
+struct MinValue : public CLI::Validator
+{
+    template<typename T>MinValue(const T value)
+    {
+        std::stringstream out;
+        out << CLI::detail::type_name<T>() << " >= " << value;
+
+        tname = out.str();
+        func = [value](std::string input) -> std::string
+        {
+            T val;
+            CLI::detail::lexical_cast(input, val);
+            if (val < value)
+                return "Value " + input + " must be larger than " + std::to_string(value);
+
+            return std::string();
+        };
+    }
+};
+
+} // namespace cliutils
+
+#endif // SRC_BIN_VALIDATORS_H_
@@ -0,0 +1,66 @@
+#include "chromavec/chromavec.h"
+
+#include <stdexcept>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+namespace chromavec {
+
+std::vector<cv::Mat> ProcessBatch(const std::vector<cv::Mat> &images,
+                                  const FilterSpec &spec,
+                                  const int num_threads)
+{
+    std::vector<cv::Mat> results(images.size());
+    ProcessBatch(
+        images.size(), spec,
+        [&images](const size_t index) { return images[index]; },
+        [&results](const size_t index, const cv::Mat &out)
+        {
+            results[index] = out;
+        },
+        num_threads
+    );
+    return results;
+}
+
+void ProcessBatch(const size_t count, const FilterSpec &spec,
+                  const BatchSource &source, const BatchSink &sink,
+                  const int num_threads)
+{
+    if (num_threads < 0)
+        throw std::runtime_error("Number of threads can't be negative.");
+
+    tbb::task_arena arena(num_threads > 0 ? num_threads
+                                          : tbb::task_arena::automatic);
+
+    // Each image is an outer task and the filter's own tasks are nested
+    // within it.  Idle workers pick up either, so there's no need to decide
+    // up front whether to parallelize across or within the images.
+    arena.execute([&]()
+    {
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, count, 1),
+            [&](const tbb::blocked_range<size_t> &range)
+            {
+                Workspace workspace;
+                for (size_t i = range.begin(); i != range.end(); i++)
+                {
+                    // An empty image is the source's way of skipping it.
+                    const cv::Mat img = source(i);
+                    if (img.empty())
+                        continue;
+
+                    // A new output for every image since the sink may hold
+                    // onto it.
+                    cv::Mat out;
+                    ApplyFilter(img, out, workspace, spec);
+                    sink(i, out);
+                }
+            }
+        );
+    });
+}
+
+} // namespace chromavec
@@ -1,6 +1,8 @@
 #include "chromavec/chromavec.h"
 
-#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
 
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -8,114 +10,529 @@
 #include "constants.h"
 
 #include "filters/canny-edges.h"
+#include "filters/gaussian.h"
 #include "filters/minimum-vector-dispersion.h"
 #include "filters/vmf.h"
 #include "filters/vector-range.h"
 
+#include "utilities/distances.h"
+
 namespace chromavec {
 
-cv::Mat VectorMedianFilter(const cv::Mat &img, const int window)
+// Internal functions
+namespace {
+
+/**
+ * @brief Smallest window where kSearchAuto uses the histogram search.
+ */
+constexpr int kHistogramSearchWindow = 15;
+
+/**
+ * @brief Convert the public tiling settings into the tiled driver's layout.
+ * @throws std::runtime_error
+ *      if the tile size is negative or the partitioner is unknown
+ */
+internal::TileLayout ToTileLayout(const Tiling &tiling)
 {
-    return internal::Filter<internal::VMFilter>(img, window);;
+    if (tiling.rows < 0 || tiling.cols < 0)
+        throw std::runtime_error("Tile size can't be negative.");
+
+    internal::TileLayout layout;
+    layout.rows = tiling.rows;
+    layout.cols = tiling.cols;
+
+    switch (tiling.partitioner)
+    {
+        case kPartitionSimple:
+            layout.partitioner = internal::Partitioner::kSimple;
+            break;
+        case kPartitionStatic:
+            layout.partitioner = internal::Partitioner::kStatic;
+            break;
+        case kPartitionAuto:
+            layout.partitioner = internal::Partitioner::kAuto;
+            break;
+        default:
+            throw std::runtime_error("Unknown tile partitioner.");
+    }
+
+    return layout;
 }
 
-cv::Mat VectorRangeFilter(const cv::Mat &img, const int window)
+/**
+ * @brief Apply a filter onto an image, reusing the output, the tile buffers and
+ *      the operators if possible.
+ */
+template<typename Operator, typename ...Args>
+void FilterInto(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                Args &&...args)
 {
-    return internal::Filter<internal::VectorRangeFilter>(img, window);
+    out.create(img.rows, img.cols, Operator::output_type);
+    internal::FilterTiles<Operator>(out, img, ToTileLayout(workspace.tiling),
+                                    workspace.tiles, workspace.operators,
+                                    std::forward<Args>(args)...);
 }
 
-cv::Mat MinimumVectorDispersionFilter(const cv::Mat &img, const int k,
-                                      const int l, const int window)
+/**
+ * The vector order-statistic filters have specializations for the common
+ * window sizes where the window width is known at compile time.  Any other
+ * size uses the generic implementation.
+ *
+ * @brief Apply a windowed filter, using a fixed-size version if available.
+ */
+template<template<typename, int, typename> class Operator, typename Distance,
+         typename T, typename ...Args>
+void FilterWindow(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                  const int window, Args &&...args)
 {
-    return internal::Filter<internal::MinVecDispersionFilter>(img, window,
-                                                              k, l);
+    switch (window)
+    {
+        case 3:
+            FilterInto<Operator<Distance, 3, T>>(img, out, workspace, window,
+                                                 args...);
+            break;
+        case 5:
+            FilterInto<Operator<Distance, 5, T>>(img, out, workspace, window,
+                                                 args...);
+            break;
+        case 7:
+            FilterInto<Operator<Distance, 7, T>>(img, out, workspace, window,
+                                                 args...);
+            break;
+        default:
+            FilterInto<Operator<Distance, internal::kDynamicWidth, T>>(
+                img, out, workspace, window, args...
+            );
+            break;
+    }
 }
 
-cv::Mat ColourVectorGradientFilter(const cv::Mat &img, const double sigma,
-                                   const GradientMode mode)
+/**
+ * @brief Call a function with the channel type of an image and the distance
+ *      policy for a metric.
+ * @param img
+ *      the image being filtered
+ * @param metric
+ *      the requested distance metric
+ * @param func
+ *      generic function called as `func(channel, distance)`
+ * @throws std::runtime_error
+ *      if either the image depth or the metric isn't supported
+ */
+template<typename Function>
+void WithDepthAndDistance(const cv::Mat &img, const DistanceMetric metric,
+                          Function &&func)
 {
-    using internal::Filter;
-    using internal::ColourGradient;
-    using internal::GradientToHSV;
+    internal::WithDepth(img.depth(), [&](auto channel)
+    {
+        internal::WithDistance(metric, [&](auto distance)
+        {
+            func(channel, distance);
+        });
+    });
+}
+
+/**
+ * @brief Records how long each stage of a filter takes.
+ *
+ * Nothing is timed if there isn't a Stats object to record into.
+ */
+class StageTimer
+{
+public:
+    StageTimer(Stats *stats)
+        : stats_(stats)
+    {
+        if (stats != nullptr)
+        {
+            this->start_ = Clock::now();
+            this->last_ = this->start_;
+        }
+    }
+
+    /**
+     * @brief Record the time since the previous stage.
+     * @param field
+     *      the field that receives the stage's time
+     */
+    void Stage(double Stats::*field)
+    {
+        if (this->stats_ == nullptr)
+            return;
+
+        const Clock::time_point now = Clock::now();
+        this->stats_->*field = Seconds(now - this->last_);
+        this->last_ = now;
+    }
+
+    /**
+     * @brief The time since the timer was created.
+     */
+    double Total() const
+    {
+        return Seconds(this->last_ - this->start_);
+    }
 
-    cv::Mat filtered;
-    if (sigma < 0.01)
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static double Seconds(const Clock::duration &duration)
     {
-        img.copyTo(filtered);
+        return std::chrono::duration<double>(duration).count();
     }
-    else
+
+    Stats *stats_;
+    Clock::time_point start_;
+    Clock::time_point last_;
+};
+
+/**
+ * @brief Count the pixels in each of the Canny edge classes.
+ */
+void CountEdgeClasses(const cv::Mat &classes, Stats &stats)
+{
+    stats.strong_pixels = 0;
+    stats.weak_pixels = 0;
+
+    for (int y = 0; y < classes.rows; y++)
     {
-        cv::GaussianBlur(img, filtered, cv::Size(), sigma, 0,
-                         cv::BORDER_REPLICATE);
+        const uint8_t *row = classes.ptr<uint8_t>(y);
+        for (int x = 0; x < classes.cols; x++)
+        {
+            stats.strong_pixels += row[x] == 255;
+            stats.weak_pixels += row[x] == 127;
+        }
     }
 
+    stats.none_pixels = static_cast<int64_t>(classes.total()) -
+                        stats.strong_pixels - stats.weak_pixels;
+}
+
+} // end of anonymous namespace
+
+void Workspace::Release()
+{
+    this->gradient.release();
+    this->classes.release();
+    this->hsv.release();
+    this->region.release();
+    this->tiles.clear();
+    this->operators.clear();
+    this->strips.clear();
+    this->rings.clear();
+    this->stacks.clear();
+}
+
+cv::Mat VectorMedianFilter(const cv::Mat &img, const int window,
+                           const MedianSearch search,
+                           const DistanceMetric metric)
+{
+    Workspace workspace;
     cv::Mat out;
+    VectorMedianFilter(img, out, workspace, window, search, metric);
+    return out;
+}
+
+void VectorMedianFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                        const int window, const MedianSearch search,
+                        const DistanceMetric metric)
+{
+    // The histogram search relies on the closed form of the Euclidean
+    // distance and on 8-bit colours.
+    const bool use_histogram =
+        metric == kEuclidean && img.depth() == CV_8U &&
+        (search == kSearchHistogram ||
+         (search == kSearchAuto && window >= kHistogramSearchWindow));
 
-    switch (mode)
+    if (use_histogram)
     {
-        case kDirectOutput:
-            out = Filter<ColourGradient>(filtered);
-            break;
-        case kMagnitudeOnly:
-            {
-                std::vector<cv::Mat> channels;
-                cv::Mat temp = Filter<ColourGradient>(filtered);
-                cv::split(temp, channels);
-                channels[1].copyTo(out);
-                out = 255*(out / internal::kMaxDistance);
-            }
-            break;
-        case kToHSV:
-            out = Filter<GradientToHSV>(Filter<ColourGradient>(filtered));
-            cv::cvtColor(out, out, CV_HSV2BGR);
-            break;
+        FilterInto<internal::HistogramVMFilter>(img, out, workspace, window);
+        return;
     }
 
+    WithDepthAndDistance(img, metric, [&](auto channel, auto distance)
+    {
+        typedef decltype(channel) T;
+        typedef decltype(distance) Distance;
+        FilterWindow<internal::VMFilter, Distance, T>(img, out, workspace,
+                                                      window);
+    });
+}
+
+cv::Mat VectorRangeFilter(const cv::Mat &img, const int window,
+                          const DistanceMetric metric)
+{
+    Workspace workspace;
+    cv::Mat out;
+    VectorRangeFilter(img, out, workspace, window, metric);
     return out;
 }
 
+void VectorRangeFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                       const int window, const DistanceMetric metric)
+{
+    WithDepthAndDistance(img, metric, [&](auto channel, auto distance)
+    {
+        typedef decltype(channel) T;
+        typedef decltype(distance) Distance;
+        FilterWindow<internal::VectorRangeFilter, Distance, T>(
+            img, out, workspace, window
+        );
+    });
+}
+
+cv::Mat MinimumVectorDispersionFilter(const cv::Mat &img, const int k,
+                                      const int l, const int window,
+                                      const DistanceMetric metric)
+{
+    Workspace workspace;
+    cv::Mat out;
+    MinimumVectorDispersionFilter(img, out, workspace, k, l, window, metric);
+    return out;
+}
+
+void MinimumVectorDispersionFilter(const cv::Mat &img, cv::Mat &out,
+                                   Workspace &workspace, const int k,
+                                   const int l, const int window,
+                                   const DistanceMetric metric)
+{
+    WithDepthAndDistance(img, metric, [&](auto channel, auto distance)
+    {
+        typedef decltype(channel) T;
+        typedef decltype(distance) Distance;
+        FilterWindow<internal::MinVecDispersionFilter, Distance, T>(
+            img, out, workspace, window, k, l
+        );
+    });
+}
+
+cv::Mat ColourVectorGradientFilter(const cv::Mat &img, const double sigma,
+                                   const GradientMode mode,
+                                   const DistanceMetric metric)
+{
+    Workspace workspace;
+    cv::Mat out;
+    ColourVectorGradientFilter(img, out, workspace, sigma, mode, metric);
+    return out;
+}
+
+void ColourVectorGradientFilter(const cv::Mat &img, cv::Mat &out,
+                                Workspace &workspace, const double sigma,
+                                const GradientMode mode,
+                                const DistanceMetric metric)
+{
+    using internal::ColourGradientImage;
+    using internal::GradientToHSV;
+    using internal::GradientToMagnitude;
+
+    // The pre-filter is applied as part of computing the gradient.
+    WithDepthAndDistance(img, metric, [&](auto channel, auto distance)
+    {
+        typedef decltype(channel) T;
+        typedef decltype(distance) Distance;
+
+        // The raw gradient can be written straight into the output.
+        if (mode == kDirectOutput)
+        {
+            ColourGradientImage<Distance, T>(img, out, sigma,
+                                             workspace.strips);
+            return;
+        }
+
+        ColourGradientImage<Distance, T>(img, workspace.gradient, sigma,
+                                         workspace.strips);
+
+        const int max_length = Distance::template MaxLength<T>();
+        switch (mode)
+        {
+            case kMagnitudeOnly:
+                FilterInto<GradientToMagnitude<T>>(workspace.gradient, out,
+                                                   workspace);
+                out.convertTo(out, -1,
+                              internal::kChannelMax<T>*(1.0 / max_length));
+                break;
+            case kToHSV:
+                FilterInto<GradientToHSV<T>>(workspace.gradient, workspace.hsv,
+                                             workspace, max_length);
+                cv::cvtColor(workspace.hsv, out, CV_HSV2BGR);
+                break;
+            default:
+                break;
+        }
+    });
+}
+
 cv::Mat ColourCannyEdgeDetect(const cv::Mat &img, const double t1,
-                              const double t2, const double sigma)
+                              const double t2, const double sigma,
+                              const DistanceMetric metric, Stats *stats)
+{
+    Workspace workspace;
+    cv::Mat out;
+    ColourCannyEdgeDetect(img, out, workspace, t1, t2, sigma, metric, stats);
+    return out;
+}
+
+void ColourCannyEdgeDetect(const cv::Mat &img, cv::Mat &out,
+                           Workspace &workspace, const double t1,
+                           const double t2, const double sigma,
+                           const DistanceMetric metric, Stats *stats)
 {
-    using internal::Filter;
-    using internal::ColourGradient;
-    using internal::NonMaximumSupression;
-    using internal::Threshold;
-    using internal::ConnectedComponents;
+    using internal::CannyEdgeClasses;
+    using internal::Hysteresis;
 
-    // Prefilter the image with a Gaussian kernel.
-    cv::Mat filtered;
-    if (sigma < 0.01)
+    // Only collect the statistics if they were asked for.
+    StageTimer timer(stats);
+    std::atomic<int> tasks(0);
+    std::atomic<int> *task_counter = stats != nullptr ? &tasks : nullptr;
+
+    // Perform Canny edge detection except using colour gradients.  The
+    // Gaussian pre-filter, gradient, non-maximum suppression and thresholding
+    // all happen in one pass.
+    WithDepthAndDistance(img, metric, [&](auto channel, auto distance)
     {
-        img.copyTo(filtered);
-    }
-    else
+        typedef decltype(channel) T;
+        typedef decltype(distance) Distance;
+        CannyEdgeClasses<Distance, T>(img, workspace.classes, sigma, t1, t2,
+                                      workspace.strips, workspace.rings,
+                                      task_counter);
+    });
+    timer.Stage(&Stats::classes_seconds);
+
+    // The classes have to be counted before the hysteresis changes them.  The
+    // count is its own stage so that it isn't charged to the hysteresis.
+    if (stats != nullptr)
+        CountEdgeClasses(workspace.classes, *stats);
+    timer.Stage(&Stats::counting_seconds);
+
+    // Run the connected components analysis to promote any weak edges that
+    // are connected to strong ones.
+    const int strips = Hysteresis(workspace.classes, workspace.stacks,
+                                  task_counter);
+    timer.Stage(&Stats::hysteresis_seconds);
+
+    // Remove any remaining weak edges.
+    cv::compare(workspace.classes, 127, out, cv::CMP_GT);
+    timer.Stage(&Stats::output_seconds);
+
+    if (stats != nullptr)
     {
-        cv::GaussianBlur(img, filtered, cv::Size(), sigma, 0,
-                         cv::BORDER_REPLICATE);
+        stats->promoted_pixels = cv::countNonZero(out) - stats->strong_pixels;
+        stats->hysteresis_strips = strips;
+        stats->tasks = tasks;
+        stats->total_seconds = timer.Total();
     }
+}
 
-    // Perform Canny edge detection except using colour gradients.
-    filtered = Filter<Threshold>(
-        Filter<NonMaximumSupression>(
-            Filter<ColourGradient>(filtered)
-        ), t1, t2
-    );
-
-    // Run the connected components analysis, iterating until convergence.
-    int i = 0;
-    bool was_modified = true;
-    while (was_modified)
-    {
-        was_modified = false;
-        Filter<ConnectedComponents>(filtered,
-                                    const_cast<const cv::Mat &>(filtered),
-                                    was_modified);
-        i++;
+FilterSpec FilterSpec::VectorMedian(const int window, const MedianSearch search,
+                                    const DistanceMetric metric)
+{
+    FilterSpec spec;
+    spec.type = kVectorMedian;
+    spec.window = window;
+    spec.search = search;
+    spec.metric = metric;
+    return spec;
+}
+
+FilterSpec FilterSpec::VectorRange(const int window, const DistanceMetric metric)
+{
+    FilterSpec spec;
+    spec.type = kVectorRange;
+    spec.window = window;
+    spec.metric = metric;
+    return spec;
+}
+
+FilterSpec FilterSpec::MinimumVectorDispersion(const int k, const int l,
+                                               const int window,
+                                               const DistanceMetric metric)
+{
+    FilterSpec spec;
+    spec.type = kMinimumVectorDispersion;
+    spec.k = k;
+    spec.l = l;
+    spec.window = window;
+    spec.metric = metric;
+    return spec;
+}
+
+FilterSpec FilterSpec::ColourGradient(const double sigma,
+                                      const GradientMode mode,
+                                      const DistanceMetric metric)
+{
+    FilterSpec spec;
+    spec.type = kColourGradient;
+    spec.sigma = sigma;
+    spec.mode = mode;
+    spec.metric = metric;
+    return spec;
+}
+
+FilterSpec FilterSpec::CannyEdges(const double t1, const double t2,
+                                  const double sigma,
+                                  const DistanceMetric metric)
+{
+    FilterSpec spec;
+    spec.type = kCannyEdges;
+    spec.t1 = t1;
+    spec.t2 = t2;
+    spec.sigma = sigma;
+    spec.metric = metric;
+    return spec;
+}
+
+cv::Mat ApplyFilter(const cv::Mat &img, const FilterSpec &spec)
+{
+    Workspace workspace;
+    cv::Mat out;
+    ApplyFilter(img, out, workspace, spec);
+    return out;
+}
+
+void ApplyFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                 const FilterSpec &spec)
+{
+    switch (spec.type)
+    {
+        case kVectorMedian:
+            VectorMedianFilter(img, out, workspace, spec.window, spec.search,
+                               spec.metric);
+            break;
+        case kVectorRange:
+            VectorRangeFilter(img, out, workspace, spec.window, spec.metric);
+            break;
+        case kMinimumVectorDispersion:
+            MinimumVectorDispersionFilter(img, out, workspace, spec.k, spec.l,
+                                          spec.window, spec.metric);
+            break;
+        case kColourGradient:
+            ColourVectorGradientFilter(img, out, workspace, spec.sigma,
+                                       spec.mode, spec.metric);
+            break;
+        case kCannyEdges:
+            ColourCannyEdgeDetect(img, out, workspace, spec.t1, spec.t2,
+                                  spec.sigma, spec.metric);
+            break;
+        default:
+            throw std::runtime_error("Unknown filter type.");
     }
+}
 
-    // Remove any remaining weak edges.
-    return filtered > 127;
+int FilterHalo(const FilterSpec &spec, const int depth)
+{
+    switch (spec.type)
+    {
+        case kVectorMedian:
+        case kVectorRange:
+        case kMinimumVectorDispersion:
+            return spec.window / 2;
+        case kColourGradient:
+            return 1 + internal::PreFilterRadius(spec.sigma, depth);
+        case kCannyEdges:
+            return 2 + internal::PreFilterRadius(spec.sigma, depth);
+        default:
+            throw std::runtime_error("Unknown filter type.");
+    }
 }
 
 } // namespace chromavec
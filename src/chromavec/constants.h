@@ -8,13 +8,34 @@
 #define SRC_CHROMAVEC_CONSTANTS_H_
 
 #include <cmath>
+#include <cstdint>
+#include <limits>
 
 namespace chromavec { namespace internal {
 
 constexpr double kSqrt2 = 1.4142135623730951;
+constexpr double kSqrt3 = 1.7320508075688772;
 constexpr double kPi = 3.141592653589793;
-constexpr int kMaxDistanceSq = 3*255*255;
-constexpr int kMaxDistance = 441; // floor(sqrt(3*255*255))
+
+/**
+ * @brief The largest value of a colour channel with the given type.
+ */
+template<typename T>
+constexpr int kChannelMax = std::numeric_limits<T>::max();
+
+/**
+ * @brief The largest squared Euclidean distance between two colours.
+ */
+template<typename T>
+constexpr int64_t kMaxColourDistanceSq =
+    3*static_cast<int64_t>(kChannelMax<T>)*kChannelMax<T>;
+
+/**
+ * @brief The largest Euclidean distance between two colours, truncated to an
+ *      integer.
+ */
+template<typename T>
+constexpr int kMaxColourDistance = static_cast<int>(kSqrt3*kChannelMax<T>);
 
 }} // namespace chromavec::internal
 
@@ -0,0 +1,658 @@
+#include "canny-edges.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include "gaussian.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHROMAVEC_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace chromavec { namespace internal {
+
+// Internal functions
+namespace {
+
+/**
+ * A gradient kernel processes as much of a row as it can and returns the
+ * column where it stopped.  The remaining pixels are handled by the scalar
+ * code.  The row pointers are to the padded rows around the current one.
+ */
+typedef int (*GradientKernel)(const uint8_t *above, const uint8_t *centre,
+                              const uint8_t *below, const int x0, const int x1,
+                              const int cols, uint16_t *row);
+
+#ifdef CHROMAVEC_X86_SIMD
+
+// The kernels below compute the magnitudes exactly as the scalar code does.
+// For the Euclidean distance that means truncated square roots.  Comparing
+// the squared distances directly would change which direction wins when two
+// truncated magnitudes are equal.  The square root of an integer below 2^24 is
+// exact enough in single precision that truncating it gives the same result as
+// the double-precision version.  The Manhattan and Chebyshev distances are
+// exact integer operations.
+
+#define CHROMAVEC_AVX2 __attribute__((target("avx2")))
+#define CHROMAVEC_SSE41 __attribute__((target("sse4.1")))
+
+/**
+ * @brief Holds the three colour channels of 8 pixels in 32-bit lanes.
+ */
+struct PixelsAVX2
+{
+    __m256i c0, c1, c2;
+};
+
+/**
+ * @brief Load 8 consecutive BGR pixels (reads 32 bytes).
+ */
+CHROMAVEC_AVX2 inline PixelsAVX2 LoadAVX2(const uint8_t *ptr)
+{
+    // Move bytes 0-15 into the lower 128-bit lane and bytes 12-27 into the
+    // upper lane so that the same per-lane shuffle expands pixels 0-3 and 4-7.
+    const __m256i perm = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i shuf0 = _mm256_setr_epi8(
+        0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1,
+        0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m256i shuf1 = _mm256_setr_epi8(
+        1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1,
+        1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+    const __m256i shuf2 = _mm256_setr_epi8(
+        2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1,
+        2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+
+    const __m256i bytes = _mm256_permutevar8x32_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr)), perm);
+
+    return PixelsAVX2{
+        _mm256_shuffle_epi8(bytes, shuf0),
+        _mm256_shuffle_epi8(bytes, shuf1),
+        _mm256_shuffle_epi8(bytes, shuf2)
+    };
+}
+
+/**
+ * @brief Compute the truncated distance between two sets of pixels.
+ */
+template<typename Distance>
+CHROMAVEC_AVX2 inline __m256i DeltaAVX2(const PixelsAVX2 &p1,
+                                        const PixelsAVX2 &p2)
+{
+    const __m256i d0 = _mm256_sub_epi32(p1.c0, p2.c0);
+    const __m256i d1 = _mm256_sub_epi32(p1.c1, p2.c1);
+    const __m256i d2 = _mm256_sub_epi32(p1.c2, p2.c2);
+
+    if constexpr (std::is_same_v<Distance, ManhattanDistance>)
+    {
+        return _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_abs_epi32(d0), _mm256_abs_epi32(d1)),
+            _mm256_abs_epi32(d2));
+    }
+    else if constexpr (std::is_same_v<Distance, ChebyshevDistance>)
+    {
+        return _mm256_max_epi32(
+            _mm256_max_epi32(_mm256_abs_epi32(d0), _mm256_abs_epi32(d1)),
+            _mm256_abs_epi32(d2));
+    }
+    else
+    {
+        const __m256i sqdist = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_mullo_epi32(d0, d0),
+                             _mm256_mullo_epi32(d1, d1)),
+            _mm256_mullo_epi32(d2, d2));
+
+        return _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(sqdist)));
+    }
+}
+
+/**
+ * @brief Select the gradient if it is strictly larger than the current one.
+ */
+CHROMAVEC_AVX2 inline void ArgMaxAVX2(const __m256i grad, const int angle,
+                                      __m256i &max_grad, __m256i &direction)
+{
+    const __m256i mask = _mm256_cmpgt_epi32(grad, max_grad);
+    max_grad = _mm256_blendv_epi8(max_grad, grad, mask);
+    direction = _mm256_blendv_epi8(direction, _mm256_set1_epi32(angle / 45),
+                                   mask);
+}
+
+template<typename Distance>
+CHROMAVEC_AVX2 int GradientRowAVX2(const uint8_t *above, const uint8_t *centre,
+                                   const uint8_t *below, const int x0,
+                                   const int x1, const int cols, uint16_t *row)
+{
+    // Each load reads 32 bytes (10+ pixels) starting one pixel to the right
+    // of the current one.  The padding column is the last readable pixel.
+    int x = x0;
+    for (; x + 8 <= x1 && x + 11 <= cols; x += 8)
+    {
+        const int l = 3*(x - 1);
+        const int c = 3*x;
+        const int r = 3*(x + 1);
+
+        const PixelsAVX2 above_l = LoadAVX2(above + l);
+        const PixelsAVX2 above_c = LoadAVX2(above + c);
+        const PixelsAVX2 above_r = LoadAVX2(above + r);
+        const PixelsAVX2 centre_l = LoadAVX2(centre + l);
+        const PixelsAVX2 centre_r = LoadAVX2(centre + r);
+        const PixelsAVX2 below_l = LoadAVX2(below + l);
+        const PixelsAVX2 below_c = LoadAVX2(below + c);
+        const PixelsAVX2 below_r = LoadAVX2(below + r);
+
+        // Evaluate the four directions (0, 90, 45 and 135 degrees) in the
+        // same order as the scalar code.
+        __m256i max_grad = DeltaAVX2<Distance>(centre_r, centre_l);
+        __m256i direction = _mm256_set1_epi32(kAngles[0] / 45);
+        ArgMaxAVX2(DeltaAVX2<Distance>(below_c, above_c), kAngles[1],
+                   max_grad, direction);
+        ArgMaxAVX2(DeltaAVX2<Distance>(below_r, above_l), kAngles[2],
+                   max_grad, direction);
+        ArgMaxAVX2(DeltaAVX2<Distance>(above_r, below_l), kAngles[3],
+                   max_grad, direction);
+
+        // Pack the gradients (see PackGradient()) and narrow them to 16 bits.
+        const __m256i packed = _mm256_or_si256(
+            _mm256_slli_epi32(max_grad, kDirectionBits), direction);
+        const __m128i narrowed = _mm_packus_epi32(
+            _mm256_castsi256_si128(packed),
+            _mm256_extracti128_si256(packed, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row + x), narrowed);
+    }
+
+    return x;
+}
+
+/**
+ * @brief Holds the three colour channels of 4 pixels in 32-bit lanes.
+ */
+struct PixelsSSE41
+{
+    __m128i c0, c1, c2;
+};
+
+/**
+ * @brief Load 4 consecutive BGR pixels (reads 16 bytes).
+ */
+CHROMAVEC_SSE41 inline PixelsSSE41 LoadSSE41(const uint8_t *ptr)
+{
+    const __m128i shuf0 = _mm_setr_epi8(
+        0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m128i shuf1 = _mm_setr_epi8(
+        1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+    const __m128i shuf2 = _mm_setr_epi8(
+        2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+
+    return PixelsSSE41{
+        _mm_shuffle_epi8(bytes, shuf0),
+        _mm_shuffle_epi8(bytes, shuf1),
+        _mm_shuffle_epi8(bytes, shuf2)
+    };
+}
+
+/**
+ * @brief Compute the truncated distance between two sets of pixels.
+ */
+template<typename Distance>
+CHROMAVEC_SSE41 inline __m128i DeltaSSE41(const PixelsSSE41 &p1,
+                                          const PixelsSSE41 &p2)
+{
+    const __m128i d0 = _mm_sub_epi32(p1.c0, p2.c0);
+    const __m128i d1 = _mm_sub_epi32(p1.c1, p2.c1);
+    const __m128i d2 = _mm_sub_epi32(p1.c2, p2.c2);
+
+    if constexpr (std::is_same_v<Distance, ManhattanDistance>)
+    {
+        return _mm_add_epi32(
+            _mm_add_epi32(_mm_abs_epi32(d0), _mm_abs_epi32(d1)),
+            _mm_abs_epi32(d2));
+    }
+    else if constexpr (std::is_same_v<Distance, ChebyshevDistance>)
+    {
+        return _mm_max_epi32(
+            _mm_max_epi32(_mm_abs_epi32(d0), _mm_abs_epi32(d1)),
+            _mm_abs_epi32(d2));
+    }
+    else
+    {
+        const __m128i sqdist = _mm_add_epi32(
+            _mm_add_epi32(_mm_mullo_epi32(d0, d0), _mm_mullo_epi32(d1, d1)),
+            _mm_mullo_epi32(d2, d2));
+
+        return _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(sqdist)));
+    }
+}
+
+/**
+ * @brief Select the gradient if it is strictly larger than the current one.
+ */
+CHROMAVEC_SSE41 inline void ArgMaxSSE41(const __m128i grad, const int angle,
+                                        __m128i &max_grad, __m128i &direction)
+{
+    const __m128i mask = _mm_cmpgt_epi32(grad, max_grad);
+    max_grad = _mm_blendv_epi8(max_grad, grad, mask);
+    direction = _mm_blendv_epi8(direction, _mm_set1_epi32(angle / 45), mask);
+}
+
+template<typename Distance>
+CHROMAVEC_SSE41 int GradientRowSSE41(const uint8_t *above, const uint8_t *centre,
+                                     const uint8_t *below, const int x0,
+                                     const int x1, const int cols, uint16_t *row)
+{
+    // Each load reads 16 bytes (5+ pixels) starting one pixel to the right of
+    // the current one.  The padding column is the last readable pixel.
+    int x = x0;
+    for (; x + 4 <= x1 && x + 6 <= cols; x += 4)
+    {
+        const int l = 3*(x - 1);
+        const int c = 3*x;
+        const int r = 3*(x + 1);
+
+        const PixelsSSE41 above_l = LoadSSE41(above + l);
+        const PixelsSSE41 above_c = LoadSSE41(above + c);
+        const PixelsSSE41 above_r = LoadSSE41(above + r);
+        const PixelsSSE41 centre_l = LoadSSE41(centre + l);
+        const PixelsSSE41 centre_r = LoadSSE41(centre + r);
+        const PixelsSSE41 below_l = LoadSSE41(below + l);
+        const PixelsSSE41 below_c = LoadSSE41(below + c);
+        const PixelsSSE41 below_r = LoadSSE41(below + r);
+
+        // Evaluate the four directions (0, 90, 45 and 135 degrees) in the
+        // same order as the scalar code.
+        __m128i max_grad = DeltaSSE41<Distance>(centre_r, centre_l);
+        __m128i direction = _mm_set1_epi32(kAngles[0] / 45);
+        ArgMaxSSE41(DeltaSSE41<Distance>(below_c, above_c), kAngles[1],
+                    max_grad, direction);
+        ArgMaxSSE41(DeltaSSE41<Distance>(below_r, above_l), kAngles[2],
+                    max_grad, direction);
+        ArgMaxSSE41(DeltaSSE41<Distance>(above_r, below_l), kAngles[3],
+                    max_grad, direction);
+
+        // Pack the gradients (see PackGradient()) and narrow them to 16 bits.
+        const __m128i packed = _mm_or_si128(
+            _mm_slli_epi32(max_grad, kDirectionBits), direction);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(row + x),
+                         _mm_packus_epi32(packed, packed));
+    }
+
+    return x;
+}
+
+#undef CHROMAVEC_AVX2
+#undef CHROMAVEC_SSE41
+
+#endif // CHROMAVEC_X86_SIMD
+
+/**
+ * @brief Pick the best gradient kernel for the current CPU.
+ * @tparam Distance
+ *      the distance policy used to compute the gradients
+ * @return
+ *      the kernel, or `nullptr` if only the scalar code is available
+ */
+template<typename Distance>
+GradientKernel SelectGradientKernel()
+{
+#ifdef CHROMAVEC_X86_SIMD
+    if (cv::checkHardwareSupport(CV_CPU_AVX2))
+        return GradientRowAVX2<Distance>;
+    if (cv::checkHardwareSupport(CV_CPU_SSE4_1))
+        return GradientRowSSE41<Distance>;
+#endif
+    return nullptr;
+}
+
+/**
+ * @brief Number of rows in each of the hysteresis strips.
+ */
+constexpr int kHysteresisRows = 64;
+
+/**
+ * @brief Minimum number of rows in each of the fused Canny strips.
+ */
+constexpr int kCannyStripRows = 32;
+
+/**
+ * Every strip has to blur the rows in its halo as well as its own rows.  The
+ * strips are made taller as the halo grows so that this overhead is bounded.
+ *
+ * @brief Ratio between the strip height and the size of its halo.
+ */
+constexpr int kStripHaloRatio = 4;
+
+/**
+ * @brief Flood-fill weak edges from the pixels on a stack.
+ * @param img
+ *      the edge image
+ * @param stack
+ *      the initial set of strong edges; empty once the fill is complete
+ * @param y0, y1
+ *      the range of rows the fill is allowed to modify
+ */
+void FloodWeakEdges(cv::Mat &img, std::vector<cv::Point> &stack,
+                    const int y0, const int y1)
+{
+    while (!stack.empty())
+    {
+        const cv::Point p = stack.back();
+        stack.pop_back();
+
+        for (int y = std::max(p.y - 1, y0); y <= std::min(p.y + 1, y1 - 1); y++)
+        {
+            uint8_t *row = img.ptr<uint8_t>(y);
+            for (int x = std::max(p.x - 1, 0); x <= std::min(p.x + 1, img.cols - 1); x++)
+            {
+                if (row[x] == 127)
+                {
+                    row[x] = 255;
+                    stack.emplace_back(x, y);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Each strip is pre-filtered separately, along with the rows around it that
+ * the operator needs, so the blurred rows are used while they're still in the
+ * cache and the blurred image is never stored in full.  The blurred rows go
+ * into a pair of buffers owned by the worker thread, one for the rows and one
+ * for the intermediate passes of the blur.
+ *
+ * @brief Process an image in parallel strips of pre-filtered rows.
+ * @param img
+ *      the input image
+ * @param sigma
+ *      the sigma of the Gaussian pre-filter
+ * @param halo
+ *      the number of rows above and below a strip that the body reads
+ * @param strips
+ *      the per-thread buffers for the blurred rows
+ * @param tasks
+ *      if provided, incremented for every strip
+ * @param body
+ *      called as `body(y0, y1, rows, first_row, slot)` for the strip covering
+ *      image rows [y0, y1), where row 'i' of 'rows' is image row
+ *      'first_row + i' and 'slot' is the worker thread's slot in the task
+ *      arena; the rows aren't padded
+ */
+template<typename Body>
+void ForEachBlurredStrip(const cv::Mat &img, const double sigma,
+                         const int halo, StripBuffers &strips,
+                         std::atomic<int> *tasks, Body &&body)
+{
+    const int strip_rows = std::max(
+        kCannyStripRows, kStripHaloRatio*(PreFilterRadius(sigma, img.depth()) + halo)
+    );
+    const int num_strips = (img.rows + strip_rows - 1) / strip_rows;
+
+    const size_t num_workers = tbb::this_task_arena::max_concurrency();
+    if (strips.size() < 2*num_workers)
+        strips.resize(2*num_workers);
+
+    tbb::parallel_for(0, num_strips, [&](const int strip)
+    {
+        if (tasks != nullptr)
+            tasks->fetch_add(1, std::memory_order_relaxed);
+
+        const int y0 = strip*strip_rows;
+        const int y1 = std::min(y0 + strip_rows, img.rows);
+        const int first_row = std::max(y0 - halo, 0);
+        const int last_row = std::min(y1 + halo, img.rows);
+
+        // OpenCV may run the blur in parallel.  Isolating the strip stops this
+        // thread from picking up another strip, and reusing its buffers, while
+        // it waits for the blur to finish.
+        tbb::this_task_arena::isolate([&]()
+        {
+            const int slot = tbb::this_task_arena::current_thread_index();
+            const cv::Mat rows = PreFilterRows(img, sigma, first_row, last_row,
+                                               strips[2*slot],
+                                               strips[2*slot + 1]);
+            body(y0, y1, rows, first_row, slot);
+        });
+    });
+}
+
+} // end of anonymous namespace
+
+int Hysteresis(cv::Mat &img, FloodStacks &stacks, std::atomic<int> *tasks)
+{
+    if (img.type() != CV_8UC1)
+        throw std::runtime_error("Hysteresis requires an 8-bit, single channel image.");
+
+    const int num_strips = (img.rows + kHysteresisRows - 1) / kHysteresisRows;
+
+    // The last stack is used for the strip boundaries.
+    const size_t num_workers = tbb::this_task_arena::max_concurrency();
+    if (stacks.size() < num_workers + 1)
+        stacks.resize(num_workers + 1);
+
+    // Flood-fill each strip independently.  A strip only modifies its own
+    // rows, so this is race-free.
+    tbb::parallel_for(0, num_strips, [&img, &stacks, tasks](const int strip)
+    {
+        if (tasks != nullptr)
+            tasks->fetch_add(1, std::memory_order_relaxed);
+
+        const int y0 = strip*kHysteresisRows;
+        const int y1 = std::min(y0 + kHysteresisRows, img.rows);
+
+        std::vector<cv::Point> &stack =
+            stacks[tbb::this_task_arena::current_thread_index()];
+        for (int y = y0; y < y1; y++)
+        {
+            const uint8_t *row = img.ptr<uint8_t>(y);
+            for (int x = 0; x < img.cols; x++)
+            {
+                if (row[x] == 255)
+                {
+                    stack.emplace_back(x, y);
+                    FloodWeakEdges(img, stack, y0, y1);
+                }
+            }
+        }
+    });
+
+    // Any chain that still needs to be filled must cross a strip boundary, and
+    // once it does, it has a strong edge on one of the boundary rows.  Seeding
+    // from those rows finishes the fill.
+    std::vector<cv::Point> &stack = stacks.back();
+    for (int strip = 1; strip < num_strips; strip++)
+    {
+        const int boundary = strip*kHysteresisRows;
+        for (int y = boundary - 1; y <= boundary; y++)
+        {
+            const uint8_t *row = img.ptr<uint8_t>(y);
+            for (int x = 0; x < img.cols; x++)
+            {
+                if (row[x] == 255)
+                    stack.emplace_back(x, y);
+            }
+        }
+    }
+
+    FloodWeakEdges(img, stack, 0, img.rows);
+    return num_strips;
+}
+
+template<typename Distance, typename T>
+void ColourGradientImage(const cv::Mat &img, cv::Mat &gradient,
+                         const double sigma, StripBuffers &strips,
+                         std::atomic<int> *tasks)
+{
+    typedef typename GradientType<T>::type gradient_type;
+
+    if (img.type() != RGBImageType<T>::value)
+        throw std::runtime_error("Input type not supported by this filter.");
+
+    gradient.create(img.rows, img.cols, GradientType<T>::ocv_type);
+
+    // The gradient only needs the rows directly above and below.
+    ForEachBlurredStrip(img, sigma, 1, strips, tasks,
+                        [&](const int y0, const int y1, const cv::Mat &rows,
+                            const int first_row, const int)
+    {
+        // The strip only runs out of rows at the image edges, so clamping to
+        // the strip is the same as clamping to the image.
+        for (int y = y0; y < y1; y++)
+        {
+            const int yi = y - first_row;
+            ColourGradient<Distance, T>::ClampedRow(
+                rows.ptr<T>(std::max(yi - 1, 0)), rows.ptr<T>(yi),
+                rows.ptr<T>(std::min(yi + 1, rows.rows - 1)), img.cols,
+                gradient.ptr<gradient_type>(y)
+            );
+        }
+    });
+}
+
+template<typename Distance, typename T>
+void CannyEdgeClasses(const cv::Mat &img, cv::Mat &classes,
+                      const double sigma, const float min_th,
+                      const float max_th, StripBuffers &strips,
+                      StripBuffers &rings, std::atomic<int> *tasks)
+{
+    typedef typename GradientType<T>::type gradient_type;
+
+    if (img.type() != RGBImageType<T>::value)
+        throw std::runtime_error("Input type not supported by this filter.");
+
+    classes.create(img.rows, img.cols, CV_8UC1);
+
+    const Threshold<T> threshold(min_th, max_th);
+
+    // Every worker thread has its own gradient rows.  The first three rows are
+    // a ring buffer, indexed by the image row modulo three, and the last one
+    // holds the suppressed magnitudes.  Each row has an extra column on either
+    // side so the suppression can read past the image edges.
+    const size_t num_workers = tbb::this_task_arena::max_concurrency();
+    if (rings.size() < num_workers)
+        rings.resize(num_workers);
+
+    // The suppression needs the gradients one row above and below, which in
+    // turn need the rows above and below those.
+    ForEachBlurredStrip(img, sigma, 2, strips, tasks,
+                        [&](const int y0, const int y1, const cv::Mat &rows,
+                            const int first_row, const int slot)
+    {
+        cv::Mat &ring = rings[slot];
+        if (ring.type() != GradientType<T>::ocv_type || ring.rows < 4 ||
+            ring.cols < img.cols + 2)
+        {
+            ring.create(4, img.cols + 2, GradientType<T>::ocv_type);
+        }
+
+        std::array<int, 3> ring_rows{-1, -1, -1};
+
+        auto gradient_row = [&](const int y) -> const gradient_type *
+        {
+            const int yc = std::clamp(y, 0, img.rows - 1);
+            gradient_type *row = ring.ptr<gradient_type>(yc % 3) + 1;
+            if (ring_rows[yc % 3] != yc)
+            {
+                // The strip only runs out of rows at the image edges, so
+                // clamping to the strip is the same as clamping to the image.
+                const int yi = yc - first_row;
+                ColourGradient<Distance, T>::ClampedRow(
+                    rows.ptr<T>(std::max(yi - 1, 0)), rows.ptr<T>(yi),
+                    rows.ptr<T>(std::min(yi + 1, rows.rows - 1)), img.cols,
+                    row
+                );
+
+                // Replicate the first and last columns.
+                row[-1] = row[0];
+                row[img.cols] = row[img.cols - 1];
+
+                ring_rows[yc % 3] = yc;
+            }
+            return row;
+        };
+
+        gradient_type *magnitudes = ring.ptr<gradient_type>(3);
+        for (int y = y0; y < y1; y++)
+        {
+            const gradient_type *above = gradient_row(y - 1);
+            const gradient_type *below = gradient_row(y + 1);
+            const gradient_type *centre = gradient_row(y);
+
+            NonMaximumSupression<T>::Row(above, centre, below, 0, img.cols,
+                                         magnitudes);
+
+            uint8_t *row = classes.ptr<uint8_t>(y);
+            for (int x = 0; x < img.cols; x++)
+                row[x] = threshold.Classify(magnitudes[x]);
+        }
+    });
+}
+
+template<typename Distance, typename T>
+void ColourGradient<Distance, T>::Row(const T *above, const T *centre,
+                                      const T *below, const int x0,
+                                      const int x1, const int cols,
+                                      gradient_type *row)
+{
+    int x = x0;
+    if constexpr (std::is_same_v<T, uint8_t>)
+    {
+        static const GradientKernel kernel = SelectGradientKernel<Distance>();
+        if (kernel != nullptr)
+            x = kernel(above, centre, below, x0, x1, cols, row);
+    }
+
+    // Handle whatever the SIMD kernel (if any) didn't.
+    for (; x < x1; x++)
+        row[x] = ColourGradient::Pixel(above, centre, below, x - 1, x, x + 1);
+}
+
+template<typename Distance, typename T>
+void ColourGradient<Distance, T>::ClampedRow(const T *above, const T *centre,
+                                             const T *below, const int cols,
+                                             gradient_type *row)
+{
+    // The interior pixels have both of their neighbours within the row.  The
+    // last pixel stands in for the padding column, so the SIMD kernels never
+    // read past the end of the row.
+    if (cols > 2)
+        ColourGradient::Row(above, centre, below, 1, cols - 1, cols - 1, row);
+
+    // Only the first and last pixels need their neighbours clamped.
+    row[0] = ColourGradient::Pixel(above, centre, below, 0, 0,
+                                   std::min(1, cols - 1));
+    if (cols > 1)
+        row[cols - 1] = ColourGradient::Pixel(above, centre, below, cols - 2,
+                                              cols - 1, cols - 1);
+}
+
+// Gradients for each of the distances and image depths.
+#define CHROMAVEC_INSTANTIATE(Distance, T) \
+template struct ColourGradient<Distance, T>; \
+template void ColourGradientImage<Distance, T>(const cv::Mat &, cv::Mat &, \
+                                              const double, StripBuffers &, \
+                                              std::atomic<int> *); \
+template void CannyEdgeClasses<Distance, T>(const cv::Mat &, cv::Mat &, \
+                                            const double, const float, \
+                                            const float, StripBuffers &, \
+                                            StripBuffers &, \
+                                            std::atomic<int> *);
+
+CHROMAVEC_INSTANTIATE(SquaredEuclideanDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(ManhattanDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(ChebyshevDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(SquaredEuclideanDistance, uint16_t)
+CHROMAVEC_INSTANTIATE(ManhattanDistance, uint16_t)
+CHROMAVEC_INSTANTIATE(ChebyshevDistance, uint16_t)
+
+#undef CHROMAVEC_INSTANTIATE
+
+}} // namespace chromavec::internal
@@ -6,9 +6,15 @@
 #ifndef SRC_CHROMAVEC_CANNY_EDGES_H_
 #define SRC_CHROMAVEC_CANNY_EDGES_H_
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
 
 #include "constants.h"
+#include "utilities/distances.h"
 #include "utilities/filter.h"
 #include "utilities/functions.h"
 #include "utilities/rgbvector.h"
@@ -22,7 +28,70 @@ constexpr std::array<int, 4> kAngles{
     135
 };
 
-template<typename T, int dx, int dy>
+/**
+ * @brief Number of bits used to store the gradient direction.
+ */
+constexpr int kDirectionBits = 2;
+
+/**
+ * The magnitude of an 8-bit colour gradient is at most 765 (for the Manhattan
+ * distance), so a packed gradient easily fits into 16 bits.  A 16-bit colour
+ * gradient can be as large as 196605, which needs a 32-bit value.
+ *
+ * @brief Define the type used to store the packed gradients of an image.
+ * @tparam T
+ *      the image's channel type
+ */
+template<typename T>
+struct GradientType
+{
+    typedef uint16_t type;
+    static constexpr int ocv_type = CV_16UC1;
+};
+
+/**
+ * @brief Store the gradients of a 16-bit image as 32-bit values.
+ */
+template<>
+struct GradientType<uint16_t>
+{
+    typedef int32_t type;
+    static constexpr int ocv_type = CV_32SC1;
+};
+
+/**
+ * Gradients are stored as a single integer value (see GradientType).  The
+ * lower two bits hold the direction, as a multiple of 45-degrees, and the
+ * remaining bits hold the magnitude.
+ *
+ * @brief Pack a gradient angle and magnitude into a single value.
+ * @param theta
+ *      gradient angle; one of the values in kAngles
+ * @param rho
+ *      gradient magnitude
+ */
+constexpr int PackGradient(const int theta, const int rho)
+{
+    return (rho << kDirectionBits) | (theta / 45);
+}
+
+/**
+ * @brief Obtain the angle, in degrees, of a packed gradient.
+ */
+constexpr int GradientAngle(const int gradient)
+{
+    return 45*(gradient & ((1 << kDirectionBits) - 1));
+}
+
+/**
+ * @brief Obtain the magnitude of a packed gradient.
+ */
+constexpr int GradientMagnitude(const int gradient)
+{
+    return gradient >> kDirectionBits;
+}
+
+template<typename Distance, typename T, int dx, int dy>
 int CalcRGBDelta(const cv::Mat &img, const int x, const int y)
 {
     const auto c1 = ClampCoordinate(img, x + dx, y + dy);
@@ -31,7 +100,7 @@ int CalcRGBDelta(const cv::Mat &img, const int x, const int y)
     const RGBVector<T> p1(img, c1.first, c1.second);
     const RGBVector<T> p2(img, c2.first, c2.second);
 
-    return std::sqrt(p1.SquaredDistance(p2));
+    return Distance::Length(Distance()(p1, p2));
 }
 
 /**
@@ -41,10 +110,23 @@ int CalcRGBDelta(const cv::Mat &img, const int x, const int y)
  * However, it is guaranteed that the vector will always be perpendicular to
  * the actual edge.
  *
+ * The gradient magnitude is the length (see distances.h) of the colour
+ * difference, truncated to an integer.
+ *
  * @brief Compute an image's colour gradients.
+ * @tparam Distance
+ *      the distance policy used to compare colours
+ * @tparam T
+ *      the image's channel type
  */
-struct ColourGradient : public OperatorBase<CV_8UC3, CV_32SC3>
+template<typename Distance = SquaredEuclideanDistance, typename T = uint8_t>
+struct ColourGradient : public OperatorBase<RGBImageType<T>::value,
+                                            GradientType<T>::ocv_type>
 {
+    typedef typename GradientType<T>::type gradient_type;
+
+    static constexpr int border = 1;
+
     RGBVector<int> operator()(const int x, const int y, const cv::Mat &img) const
     {
         typedef typename OpenCVTypeInfo<ColourGradient::input_type>::type type;
@@ -77,12 +159,99 @@ struct ColourGradient : public OperatorBase<CV_8UC3, CV_32SC3>
         // gradient responses are returned.
 
         const std::array<int, 4> sqdist{
-            CalcRGBDelta<type, 1, 0>(img, x, y),  //   0-degrees
-            CalcRGBDelta<type, 0, 1>(img, x, y),  //  90-degrees
-            CalcRGBDelta<type, 1, 1>(img, x, y),  //  45-degrees
-            CalcRGBDelta<type, 1,-1>(img, x, y)   // 135-degrees
+            CalcRGBDelta<Distance, type, 1, 0>(img, x, y),  //   0-degrees
+            CalcRGBDelta<Distance, type, 0, 1>(img, x, y),  //  90-degrees
+            CalcRGBDelta<Distance, type, 1, 1>(img, x, y),  //  45-degrees
+            CalcRGBDelta<Distance, type, 1,-1>(img, x, y)   // 135-degrees
+        };
+
+        const gradient_type gradient = ColourGradient::Polar(sqdist);
+        return RGBVector<int>(gradient, gradient, gradient);
+    }
+
+    void ProcessRow(const int y, const int x0, const int x1,
+                    const cv::Mat &img, cv::Mat &out) const
+    {
+        // The driver pads the input, so the neighbouring rows and columns can
+        // be accessed without any clamping.
+        ColourGradient::Row(img.ptr<T>(y - 1), img.ptr<T>(y),
+                            img.ptr<T>(y + 1), x0, x1, img.cols,
+                            out.ptr<gradient_type>(y));
+    }
+
+    /**
+     * The row kernel uses SIMD instructions, when they are available, to
+     * process several pixels at once.  The result is identical to the scalar
+     * path.  Only 8-bit images have a SIMD kernel.
+     *
+     * @brief Compute the gradients for a row segment.
+     * @param above, centre, below
+     *      the BGR rows around the current one; the column before the first
+     *      pixel and the column after the last pixel must be readable
+     * @param x0, x1
+     *      the range of pixels to compute
+     * @param cols
+     *      the number of pixels in each row
+     * @param row
+     *      output row of packed gradients
+     */
+    static void Row(const T *above, const T *centre, const T *below,
+                    const int x0, const int x1, const int cols,
+                    gradient_type *row);
+
+    /**
+     * The first and last pixels are computed as if the image edges were
+     * replicated, so the rows don't need to be padded.  The rows above and
+     * below must already be clamped to the image.
+     *
+     * @brief Compute the gradients for an entire, unpadded row.
+     * @param above, centre, below
+     *      the BGR rows around the current one
+     * @param cols
+     *      the number of pixels in each row
+     * @param row
+     *      output row of packed gradients
+     */
+    static void ClampedRow(const T *above, const T *centre, const T *below,
+                           const int cols, gradient_type *row);
+
+private:
+    /**
+     * @brief Compute the gradient of a single pixel.
+     * @param above, centre, below
+     *      the BGR rows around the pixel
+     * @param l, c, r
+     *      the columns to the left of, at and to the right of the pixel
+     */
+    static gradient_type Pixel(const T *above, const T *centre,
+                               const T *below, const int l, const int c,
+                               const int r)
+    {
+        const std::array<int, 4> sqdist{
+            ColourGradient::Delta(centre + 3*r, centre + 3*l),  //   0-degrees
+            ColourGradient::Delta(below + 3*c, above + 3*c),    //  90-degrees
+            ColourGradient::Delta(below + 3*r, above + 3*l),    //  45-degrees
+            ColourGradient::Delta(above + 3*r, below + 3*l)     // 135-degrees
         };
 
+        return ColourGradient::Polar(sqdist);
+    }
+
+    /**
+     * @brief Magnitude of the difference between two BGR pixels.
+     */
+    static int Delta(const T *p1, const T *p2)
+    {
+        const RGBVector<T> c1(p1, 3);
+        const RGBVector<T> c2(p2, 3);
+        return Distance::Length(Distance()(c1, c2));
+    }
+
+    /**
+     * @brief Convert the four directional gradients into a packed gradient.
+     */
+    static gradient_type Polar(const std::array<int, 4> &sqdist)
+    {
         // Find the maximum gradient of the four that were tested.
         int max_ind = 0;
         int max_grad = 0;
@@ -101,41 +270,193 @@ struct ColourGradient : public OperatorBase<CV_8UC3, CV_32SC3>
         const int theta = kAngles[max_ind];
         const int rho = max_grad;
 
-        return RGBVector<int>(theta, rho, 0);
+        return static_cast<gradient_type>(PackGradient(theta, rho));
     }
 };
 
 /**
+ * The HSV image is only meant for display, so it's always an 8-bit image.
+ *
  * @brief Convert a gradient image into HSV.
+ * @tparam T
+ *      the channel type of the image the gradients were computed from
  */
-struct GradientToHSV : public OperatorBase<CV_32SC3, CV_8UC3>
+template<typename T = uint8_t>
+struct GradientToHSV : public OperatorBase<GradientType<T>::ocv_type, CV_8UC3>
 {
+    typedef typename GradientType<T>::type gradient_type;
+
+    int max_length;
+
+    /**
+     * @brief Constructor
+     * @param max
+     *      the largest possible gradient magnitude
+     */
+    GradientToHSV(const int max = kMaxColourDistance<T>)
+        : max_length(max)
+    {
+        // do nothing
+    }
+
     RGBVector<uint8_t> operator()(const int x, const int y, const cv::Mat &img) const
     {
-        const RGBVector<int> rgb(img, x, y);
+        const gradient_type gradient = img.ptr<gradient_type>(y)[x];
         return RGBVector<uint8_t>(
-            255*(RadiansToDegrees(rgb.red)/360.0),
+            GradientToHSV::Hue(GradientAngle(gradient)),
             255,
-            255*(static_cast<double>(rgb.green) / kMaxDistance)
+            this->Value(GradientMagnitude(gradient))
         );
     }
+
+    void ProcessRow(const int y, const int x0, const int x1,
+                    const cv::Mat &img, cv::Mat &out) const
+    {
+        const gradient_type *in = img.ptr<gradient_type>(y);
+        uint8_t *row = out.ptr<uint8_t>(y);
+
+        for (int x = x0; x < x1; x++)
+        {
+            row[3*x] = GradientToHSV::Hue(GradientAngle(in[x]));
+            row[3*x+1] = 255;
+            row[3*x+2] = this->Value(GradientMagnitude(in[x]));
+        }
+    }
+
+private:
+    static uint8_t Hue(const int theta)
+    {
+        return 255*(RadiansToDegrees(theta)/360.0);
+    }
+
+    uint8_t Value(const int rho) const
+    {
+        return 255*(static_cast<double>(rho) / this->max_length);
+    }
+};
+
+/**
+ * @brief Extract the magnitudes from a gradient image.
+ * @tparam T
+ *      the channel type of the image the gradients were computed from
+ */
+template<typename T = uint8_t>
+struct GradientToMagnitude : public OperatorBase<GradientType<T>::ocv_type,
+                                                 CV_32SC1>
+{
+    typedef typename GradientType<T>::type gradient_type;
+
+    RGBVector<int> operator()(const int x, const int y, const cv::Mat &img) const
+    {
+        const int magnitude = GradientMagnitude(img.ptr<gradient_type>(y)[x]);
+        return RGBVector<int>(magnitude, magnitude, magnitude);
+    }
+
+    void ProcessRow(const int y, const int x0, const int x1,
+                    const cv::Mat &img, cv::Mat &out) const
+    {
+        const gradient_type *in = img.ptr<gradient_type>(y);
+        int32_t *row = out.ptr<int32_t>(y);
+
+        for (int x = x0; x < x1; x++)
+            row[x] = GradientMagnitude(in[x]);
+    }
 };
 
 /**
+ * The output holds the magnitudes of the gradients that were kept and has the
+ * same type as the gradient image.
+ *
  * @brief Perform Canny-style non-maximum suppresion on a gradient image.
+ * @tparam T
+ *      the channel type of the image the gradients were computed from
  */
-struct NonMaximumSupression : public OperatorBase<CV_32SC3, CV_32SC1>
+template<typename T = uint8_t>
+struct NonMaximumSupression : public OperatorBase<GradientType<T>::ocv_type,
+                                                  GradientType<T>::ocv_type>
 {
+    typedef typename GradientType<T>::type gradient_type;
+
+    static constexpr int border = 1;
+
     RGBVector<int> operator()(const int x, const int y, const cv::Mat &img) const
     {
-        const RGBVector<int> rgb(img, x, y);
+        const gradient_type gradient = img.ptr<gradient_type>(y)[x];
 
-        const int theta = rgb.red;
-        const int current_mag = rgb.green;
+        const int theta = GradientAngle(gradient);
+        const int current_mag = GradientMagnitude(gradient);
 
         // Compute the sampling direction.  This is determined by the angle of
         // the gradient at the current pixel location.
         int dx = 0, dy = 0;
+        NonMaximumSupression::Direction(theta, dx, dy);
+
+        // Sample the pixel values based on the angle, clamping if outside of
+        // the image if necessary.
+        auto get_magnitude = [&img](const int x, const int y) -> int
+        {
+            const auto c = ClampCoordinate(img, x, y);
+            return GradientMagnitude(img.ptr<gradient_type>(c.second)[c.first]);
+        };
+
+        const int m1 = get_magnitude(x + dx, y + dy);
+        const int m2 = get_magnitude(x - dx, y - dy);
+
+        // Check to see if the pixel is a maxima on either side of the gradient.
+        const bool is_max = m1 <= current_mag && m2 <= current_mag;
+        const int response = is_max ? current_mag : 0;
+        return RGBVector<int>(response, response, response);
+    }
+
+    void ProcessRow(const int y, const int x0, const int x1,
+                    const cv::Mat &img, cv::Mat &out) const
+    {
+        // The driver pads the input, so the neighbours can be accessed without
+        // any clamping.
+        NonMaximumSupression::Row(img.ptr<gradient_type>(y - 1),
+                                  img.ptr<gradient_type>(y),
+                                  img.ptr<gradient_type>(y + 1), x0, x1,
+                                  out.ptr<gradient_type>(y));
+    }
+
+    /**
+     * @brief Suppress the non-maximum gradients in a row segment.
+     * @param above, centre, below
+     *      the packed gradient rows around the current one; the column before
+     *      the first pixel and the column after the last pixel must be readable
+     * @param x0, x1
+     *      the range of pixels to process
+     * @param row
+     *      output magnitude row
+     */
+    static void Row(const gradient_type *above, const gradient_type *centre,
+                    const gradient_type *below, const int x0, const int x1,
+                    gradient_type *row)
+    {
+        const std::array<const gradient_type *, 3> rows{above, centre, below};
+
+        for (int x = x0; x < x1; x++)
+        {
+            const int theta = GradientAngle(centre[x]);
+            const int current_mag = GradientMagnitude(centre[x]);
+
+            int dx = 0, dy = 0;
+            NonMaximumSupression::Direction(theta, dx, dy);
+
+            const int m1 = GradientMagnitude(rows[1 + dy][x + dx]);
+            const int m2 = GradientMagnitude(rows[1 - dy][x - dx]);
+
+            const bool is_max = m1 <= current_mag && m2 <= current_mag;
+            row[x] = is_max ? current_mag : 0;
+        }
+    }
+
+private:
+    /**
+     * @brief Obtain the sampling direction for a gradient angle.
+     */
+    static void Direction(const int theta, int &dx, int &dy)
+    {
         if (theta < 22.5)
         {
             dx = 1;
@@ -156,30 +477,19 @@ struct NonMaximumSupression : public OperatorBase<CV_32SC3, CV_32SC1>
             dx =  1;
             dy = -1;
         }
-
-        // Sample the pixel values based on the angle, clamping if outside of
-        // the image if necessary.
-        auto get_magnitude = [&img](const int x, const int y) -> int
-        {
-            const auto c = ClampCoordinate(img, x, y);
-            return RGBVector<int>(img, c.first, c.second).green;
-        };
-
-        const int m1 = get_magnitude(x + dx, y + dy);
-        const int m2 = get_magnitude(x - dx, y - dy);
-
-        // Check to see if the pixel is a maxima on either side of the gradient.
-        const bool is_max = m1 <= current_mag && m2 <= current_mag;
-        const int response = is_max ? current_mag : 0;
-        return RGBVector<int>(response, response, response);
     }
 };
 
 /**
  * @brief Threshold a magnitude image using a double threshold.
+ * @tparam T
+ *      the channel type of the image the gradients were computed from
  */
-struct Threshold : OperatorBase<CV_32SC1, CV_8UC1>
+template<typename T = uint8_t>
+struct Threshold : OperatorBase<GradientType<T>::ocv_type, CV_8UC1>
 {
+    typedef typename GradientType<T>::type gradient_type;
+
     float min_th;
     float max_th;
 
@@ -199,76 +509,152 @@ struct Threshold : OperatorBase<CV_32SC1, CV_8UC1>
 
     RGBVector<uint8_t> operator()(const int x, const int y, const cv::Mat &img) const
     {
-        const RGBVector<int> rgb(img, x, y);
+        const uint8_t value = this->Classify(img.ptr<gradient_type>(y)[x]);
+        return RGBVector<uint8_t>(value, value, value);
+    }
 
-        RGBVector<uint8_t> out;
-        if (rgb.red > max_th)
-            out = RGBVector<uint8_t>(255, 255, 255);
-        else if (rgb.red > min_th)
-            out = RGBVector<uint8_t>(127, 127, 127);
-        else
-            out = RGBVector<uint8_t>(0, 0, 0);
+    void ProcessRow(const int y, const int x0, const int x1,
+                    const cv::Mat &img, cv::Mat &out) const
+    {
+        const gradient_type *in = img.ptr<gradient_type>(y);
+        uint8_t *row = out.ptr<uint8_t>(y);
 
-        return out;
+        for (int x = x0; x < x1; x++)
+            row[x] = this->Classify(in[x]);
     }
-};
-
-/**
- * This uses the output of the Canny double-thresholding to produce the final
- * set of edges.  This is expected to be performed iteratively until
- * convergence.
- *
- * @brief Perform connected-component analysis using double thresholds.
- */
-struct ConnectedComponents : OperatorBase<CV_8UC1, CV_8UC1>
-{
-    bool &was_modified;
 
     /**
-     * @brief Constructor
-     * @param mod
-     *      a reference to an external boolean variable that will be used to
-     *      indicate whether or not the image was modified
+     * @brief Classify a magnitude as a strong (255), weak (127) or non-edge.
      */
-    ConnectedComponents(bool &mod)
-        : was_modified(mod)
+    uint8_t Classify(const int magnitude) const
     {
-        // do nothing
+        if (magnitude > max_th)
+            return 255;
+        else if (magnitude > min_th)
+            return 127;
+        else
+            return 0;
     }
+};
 
-    RGBVector<uint8_t> operator()(const int x, const int y, const cv::Mat &img) const
-    {
-        const RGBVector<uint8_t> rgb(img, x, y);
+/**
+ * The strip-based functions below keep their per-strip scratch, e.g. the
+ * pre-filtered rows and the gradient rows, in buffers owned by the worker
+ * threads.  Like TileBuffers, the buffers are indexed by the thread's slot in
+ * the current task arena and only grow, so a set of buffers that is reused
+ * between calls is only allocated once.  A set of buffers must only be used by
+ * one call at a time.
+ *
+ * @brief Per-thread buffers used by the strip-based Canny functions.
+ */
+typedef std::vector<cv::Mat> StripBuffers;
 
-        // This is not an edge pixel, so nothing to do.
-        if (rgb.red < 127)
-            return rgb;
+/**
+ * Each worker thread has its own stack for the flood-fill of its strips.  The
+ * stack is always empty after a fill, so it can be reused straight away.  The
+ * stacks only grow and are indexed by the thread's slot in the current task
+ * arena, with one extra stack for the pass over the strip boundaries.
+ *
+ * @brief Per-thread flood-fill stacks used by Hysteresis().
+ */
+typedef std::vector<std::vector<cv::Point>> FloodStacks;
 
-        // This is a strong edge, so also, nothing to do.
-        if (rgb.red == 255)
-            return rgb;
+/**
+ * This uses the output of the Canny double-thresholding to produce the final
+ * set of edges.  Any weak edge (127) that is 8-connected to a strong edge
+ * (255), either directly or through other weak edges, becomes a strong edge.
+ * Weak edges that aren't connected to a strong edge are left as-is.
+ *
+ * The image is split into fixed-height strips that are flood-filled in
+ * parallel, starting from the strong edges in each strip.  Chains that cross
+ * a strip boundary are then finished off with a single flood-fill seeded from
+ * the boundary rows.  Every pixel is visited a bounded number of times, no
+ * matter how long the edge chains are, and the result doesn't depend on how
+ * the strips are scheduled.
+ *
+ * @brief Perform connected-component analysis using double thresholds.
+ * @param img
+ *      a CV_8UC1 image produced by the Threshold operator; it is modified
+ *      in-place
+ * @param stacks
+ *      the per-thread flood-fill stacks; grown as needed
+ * @param tasks
+ *      if provided, incremented for every parallel task that is run
+ * @return
+ *      the number of strips that were flood-filled in parallel
+ * @throws std::runtime_error
+ *      if the image isn't an 8-bit, single channel image
+ */
+int Hysteresis(cv::Mat &img, FloodStacks &stacks,
+               std::atomic<int> *tasks = nullptr);
 
-        // This is a weak edge, so need to look at its neighbours to see if one
-        // of them is a strong edge.  If it's a strong edge, mark it as a strong
-        // edge.  Otherwise, do nothing.
-        for (int dy = -1; dy <= 1; dy++)
-            for (int dx = -1; dx <= 1; dx++)
-            {
-                const auto coord = ClampCoordinate(img, x+dx, y+dy);
-                const auto value = RGBVector<uint8_t>(img,
-                                                      coord.first,
-                                                      coord.second).red;
-
-                if (value == 255)
-                {
-                    this->was_modified = true;
-                    return RGBVector<uint8_t>(255, 255, 255);
-                }
-            }
+/**
+ * The image is pre-filtered and the gradients computed in horizontal strips,
+ * so the blurred rows are consumed while they're still in the cache and the
+ * blurred image is never stored.  The output is identical to blurring with
+ * PreFilter() and then applying the ColourGradient operator.
+ *
+ * @brief Compute the colour gradient of a pre-filtered image.
+ * @tparam Distance
+ *      the distance policy used to compute the gradients
+ * @tparam T
+ *      the image's channel type
+ * @param img
+ *      three channel input image with channel type `T`
+ * @param gradient
+ *      output gradient image (see GradientType); reallocated if it isn't the
+ *      right size or type
+ * @param sigma
+ *      the sigma of the Gaussian pre-filter
+ * @param strips
+ *      the per-thread buffers for the pre-filtered rows; grown as needed
+ * @param tasks
+ *      if provided, incremented for every parallel task that is run
+ * @throws std::runtime_error
+ *      if the input isn't a three channel image with channel type `T`
+ */
+template<typename Distance = SquaredEuclideanDistance, typename T = uint8_t>
+void ColourGradientImage(const cv::Mat &img, cv::Mat &gradient,
+                         const double sigma, StripBuffers &strips,
+                         std::atomic<int> *tasks = nullptr);
 
-        return rgb;
-    }
-};
+/**
+ * This fuses the pre-filter with the ColourGradient, NonMaximumSupression and
+ * Threshold operators into a single pass.  The image is processed in
+ * horizontal strips.  Each strip blurs its own rows, plus the halo needed by
+ * the later stages, and only keeps the three gradient rows that the
+ * non-maximum suppression needs.  Only the final 8-bit edge classes are
+ * written out, so there are no full-size intermediate images.  The output is
+ * identical to running the pre-filter and the three operators one after
+ * another.
+ *
+ * @brief Compute the Canny edge classes (strong, weak or none) of an image.
+ * @tparam Distance
+ *      the distance policy used to compute the gradients
+ * @tparam T
+ *      the image's channel type
+ * @param img
+ *      three channel input image with channel type `T`
+ * @param classes
+ *      CV_8UC1 output image; reallocated if it isn't the right size or type
+ * @param sigma
+ *      the sigma of the Gaussian pre-filter
+ * @param min_th, max_th
+ *      the lower and upper thresholds
+ * @param strips
+ *      the per-thread buffers for the pre-filtered rows; grown as needed
+ * @param rings
+ *      the per-thread buffers for the gradient rows; grown as needed
+ * @param tasks
+ *      if provided, incremented for every parallel task that is run
+ * @throws std::runtime_error
+ *      if the input isn't a three channel image with channel type `T`
+ */
+template<typename Distance = SquaredEuclideanDistance, typename T = uint8_t>
+void CannyEdgeClasses(const cv::Mat &img, cv::Mat &classes,
+                      const double sigma, const float min_th,
+                      const float max_th, StripBuffers &strips,
+                      StripBuffers &rings, std::atomic<int> *tasks = nullptr);
 
 }} // namespace chromavec::internal
 
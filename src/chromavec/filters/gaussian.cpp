@@ -0,0 +1,179 @@
+#include "gaussian.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+namespace chromavec { namespace internal {
+
+// Internal functions
+namespace {
+
+/**
+ * @brief Number of box filters in the box-cascade approximation.
+ */
+constexpr int kNumBoxes = 3;
+
+/**
+ * This uses the method from "Fast Almost-Gaussian Filtering" (Kovesi, 2010) to
+ * pick the box widths so that the cascade has the same variance as the
+ * Gaussian.  The widths are odd so that each box is centred on its pixel.
+ *
+ * @brief Compute the box widths used to approximate a Gaussian.
+ */
+std::array<int, kNumBoxes> BoxWidths(const double sigma)
+{
+    const double ideal = std::sqrt(12*sigma*sigma/kNumBoxes + 1);
+
+    int lower = static_cast<int>(std::floor(ideal));
+    if (lower % 2 == 0)
+        lower--;
+    const int upper = lower + 2;
+
+    const double m = (12*sigma*sigma - kNumBoxes*lower*lower - 4*kNumBoxes*lower
+                      - 3*kNumBoxes) / (-4*lower - 4);
+    const int num_lower = std::clamp(static_cast<int>(std::round(m)), 0,
+                                     kNumBoxes);
+
+    std::array<int, kNumBoxes> widths;
+    for (int i = 0; i < kNumBoxes; i++)
+        widths[i] = i < num_lower ? lower : upper;
+
+    return widths;
+}
+
+/**
+ * @brief Obtain a view onto the first rows of a buffer, growing the buffer if
+ *      it is too small.
+ * @param buffer
+ *      the buffer
+ * @param rows
+ *      the number of rows needed
+ * @param img
+ *      the image whose width and type the rows need
+ */
+cv::Mat ReserveRows(cv::Mat &buffer, const int rows, const cv::Mat &img)
+{
+    if (buffer.type() != img.type() || buffer.rows < rows ||
+        buffer.cols < img.cols)
+    {
+        buffer.create(std::max(rows, buffer.rows), img.cols, img.type());
+    }
+
+    return buffer(cv::Rect(0, 0, img.cols, rows));
+}
+
+} // end of anonymous namespace
+
+void Blur(const cv::Mat &img, const double sigma, cv::Mat &blurred)
+{
+    cv::Mat scratch;
+    Blur(img, sigma, blurred, scratch);
+}
+
+void Blur(const cv::Mat &img, const double sigma, cv::Mat &blurred,
+          cv::Mat &scratch)
+{
+    // OpenCV reads past the edges of a submatrix into its parent image unless
+    // the border is isolated.  The input is often a view onto part of a larger
+    // buffer, so the edges of the view must be treated as the image edges.
+    constexpr int border = cv::BORDER_REPLICATE | cv::BORDER_ISOLATED;
+
+    if (sigma <= kBoxCascadeSigma)
+    {
+        cv::GaussianBlur(img, blurred, cv::Size(), sigma, 0, border);
+        return;
+    }
+
+    // Each box filter is computed with running sums, so the cost doesn't
+    // depend on the width.  The passes alternate between the two images and,
+    // since there's an odd number of them, the last one ends up in 'blurred'.
+    static_assert(kNumBoxes % 2 == 1, "The last pass must write 'blurred'.");
+    const std::array<int, kNumBoxes> widths = BoxWidths(sigma);
+
+    cv::blur(img, blurred, cv::Size(widths[0], widths[0]), cv::Point(-1, -1),
+             border);
+    for (int i = 1; i < kNumBoxes; i++)
+    {
+        const cv::Mat &src = i % 2 == 1 ? blurred : scratch;
+        cv::Mat &dst = i % 2 == 1 ? scratch : blurred;
+        cv::blur(src, dst, cv::Size(widths[i], widths[i]), cv::Point(-1, -1),
+                 border);
+    }
+}
+
+cv::Mat PreFilter(const cv::Mat &img, const double sigma, cv::Mat &buffer)
+{
+    if (sigma < 0.01)
+        return img;
+
+    Blur(img, sigma, buffer);
+    return buffer;
+}
+
+int PreFilterRadius(const double sigma, const int depth)
+{
+    if (sigma < 0.01)
+        return 0;
+
+    // cv::GaussianBlur() covers +/-3 sigma for 8-bit images and +/-4 sigma
+    // for everything else.
+    if (sigma <= kBoxCascadeSigma)
+    {
+        const int extent = depth == CV_8U ? 3 : 4;
+        return (cvRound(sigma*extent*2 + 1) | 1) / 2;
+    }
+
+    int radius = 0;
+    for (const int width : BoxWidths(sigma))
+        radius += width / 2;
+
+    return radius;
+}
+
+void PreFilterRegion(const cv::Mat &img, const double sigma,
+                     const cv::Rect &region, cv::Mat &blurred)
+{
+    const int radius = PreFilterRadius(sigma, img.depth());
+    const cv::Rect source = cv::Rect(region.x - radius, region.y - radius,
+                                     region.width + 2*radius,
+                                     region.height + 2*radius)
+                            & cv::Rect(0, 0, img.cols, img.rows);
+
+    // The blur isolates the view, so the image edges, and only the image
+    // edges, are replicated.
+    cv::Mat buffer;
+    Blur(img(source), sigma, buffer);
+
+    cv::Mat dst = blurred(region);
+    buffer(cv::Rect(region.x - source.x, region.y - source.y, region.width,
+                    region.height)).copyTo(dst);
+}
+
+cv::Mat PreFilterRows(const cv::Mat &img, const double sigma, const int y0,
+                      const int y1, cv::Mat &buffer, cv::Mat &scratch)
+{
+    if (sigma < 0.01)
+        return img.rowRange(y0, y1);
+
+    // Blur enough of the surrounding rows that the requested ones are the
+    // same as they would be for the full image.
+    const int radius = PreFilterRadius(sigma, img.depth());
+    const int src0 = std::max(y0 - radius, 0);
+    const int src1 = std::min(y1 + radius, img.rows);
+
+    // The blur writes straight into views of the buffers, so they're only
+    // reallocated when they're too small.  Only the box-filter cascade needs
+    // the scratch buffer.
+    cv::Mat blurred = ReserveRows(buffer, src1 - src0, img);
+    cv::Mat passes;
+    if (sigma > kBoxCascadeSigma)
+        passes = ReserveRows(scratch, src1 - src0, img);
+
+    Blur(img.rowRange(src0, src1), sigma, blurred, passes);
+    return blurred.rowRange(y0 - src0, y1 - src0);
+}
+
+}} // namespace chromavec::internal
@@ -0,0 +1,121 @@
+/**
+ * @file
+ * @brief The Gaussian pre-filter used by the gradient-based filters.
+ */
+#ifndef SRC_CHROMAVEC_GAUSSIAN_H_
+#define SRC_CHROMAVEC_GAUSSIAN_H_
+
+#include <opencv2/core.hpp>
+
+namespace chromavec { namespace internal {
+
+/**
+ * The cost of a true Gaussian kernel grows with its sigma.  Past this point,
+ * the pre-filter switches to a cascade of three box filters, which has a
+ * constant cost per pixel and is a close approximation of a Gaussian.
+ *
+ * @brief Largest sigma that uses an exact Gaussian kernel.
+ */
+constexpr double kBoxCascadeSigma = 3.0;
+
+/**
+ * @brief Blur an entire image with the pre-filter kernel.
+ * @param img
+ *      input image; if it's a view onto a larger image, its edges are still
+ *      treated as the image edges
+ * @param sigma
+ *      the sigma of the Gaussian filter; must need blurring
+ * @param blurred
+ *      the blurred image
+ */
+void Blur(const cv::Mat &img, const double sigma, cv::Mat &blurred);
+
+/**
+ * The box-filter cascade needs an intermediate image between its passes.
+ * Neither image is reallocated if it's already the right size and type, so
+ * either one can be a view onto a larger buffer.
+ *
+ * @brief Blur an entire image with the pre-filter kernel, using existing
+ *      storage.
+ * @param img
+ *      input image; if it's a view onto a larger image, its edges are still
+ *      treated as the image edges
+ * @param sigma
+ *      the sigma of the Gaussian filter; must need blurring
+ * @param blurred
+ *      the blurred image
+ * @param scratch
+ *      storage for the intermediate passes
+ */
+void Blur(const cv::Mat &img, const double sigma, cv::Mat &blurred,
+          cv::Mat &scratch);
+
+/**
+ * @brief Apply the Gaussian pre-filter used by the gradient-based filters.
+ * @param img
+ *      input image
+ * @param sigma
+ *      the sigma of the Gaussian filter
+ * @param buffer
+ *      storage for the blurred image
+ * @return
+ *      the blurred image, or the input itself if no blurring is needed
+ */
+cv::Mat PreFilter(const cv::Mat &img, const double sigma, cv::Mat &buffer);
+
+/**
+ * @brief The radius of the kernel used by PreFilter().
+ * @param sigma
+ *      the sigma of the Gaussian filter
+ * @param depth
+ *      the depth of the image being blurred, i.e. `img.depth()`
+ * @note For the exact Gaussian, this matches how cv::GaussianBlur() sizes the
+ *      kernel when only the sigma is given, which depends on the image depth.
+ */
+int PreFilterRadius(const double sigma, const int depth);
+
+/**
+ * The region is blurred using the pixels around it, where they're available,
+ * so the result is identical to the same region of PreFilter()'s output.
+ *
+ * @brief Apply the Gaussian pre-filter onto a region of an image.
+ * @param img
+ *      input image
+ * @param sigma
+ *      the sigma of the Gaussian filter; must need blurring
+ * @param region
+ *      the region being blurred
+ * @param blurred
+ *      the blurred image; only the region is updated
+ */
+void PreFilterRegion(const cv::Mat &img, const double sigma,
+                     const cv::Rect &region, cv::Mat &blurred);
+
+/**
+ * Only the blurred rows are ever held in memory, so a filter can blur an image
+ * a strip at a time and consume the blurred rows while they're still in the
+ * cache.  If no blurring is needed then the rows are a view onto the image
+ * and nothing is copied.  Otherwise they're blurred straight into the buffer,
+ * which is only reallocated if it's too small.  The rows aren't padded, so any
+ * reads past the image edges have to be clamped by the caller.
+ *
+ * @brief Apply the pre-filter onto a range of rows.
+ * @param img
+ *      input image
+ * @param sigma
+ *      the sigma of the Gaussian filter
+ * @param y0, y1
+ *      the range of rows being blurred
+ * @param buffer
+ *      storage for the blurred rows
+ * @param scratch
+ *      storage for the intermediate passes of the blur
+ * @return
+ *      the blurred rows, where row '0' is image row 'y0'
+ */
+cv::Mat PreFilterRows(const cv::Mat &img, const double sigma, const int y0,
+                      const int y1, cv::Mat &buffer, cv::Mat &scratch);
+
+}} // namespace chromavec::internal
+
+#endif // SRC_CHROMAVEC_GAUSSIAN_H_
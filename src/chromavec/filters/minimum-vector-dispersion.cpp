@@ -1,20 +1,57 @@
 #include "minimum-vector-dispersion.h"
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
+#include <utility>
 
 #include "constants.h"
-#include "utilities/functions.h"
-#include "utilities/roi.h"
 
 namespace chromavec { namespace internal {
 
-MinVecDispersionFilter::MinVecDispersionFilter(const int width, const int k,
-                                               const int l)
+// Internal functions
+namespace {
+
+/**
+ * @brief Pack an 8-bit aggregate distance and a pixel index into a key.
+ */
+int64_t MakeKey(const int aggregate, const int index)
+{
+    return (static_cast<int64_t>(aggregate) << 32) | index;
+}
+
+/**
+ * @brief Pair a 16-bit aggregate distance with a pixel index.
+ */
+std::pair<int64_t, int> MakeKey(const int64_t aggregate, const int index)
+{
+    return std::make_pair(aggregate, index);
+}
+
+/**
+ * @brief Obtain the pixel index stored in a packed key.
+ */
+int KeyIndex(const int64_t key)
+{
+    return static_cast<int>(key & 0xFFFFFFFF);
+}
+
+/**
+ * @brief Obtain the pixel index stored in a paired key.
+ */
+int KeyIndex(const std::pair<int64_t, int> &key)
+{
+    return key.second;
+}
+
+} // end of anonymous namespace
+
+template<typename Distance, int FixedWidth, typename T>
+MinVecDispersionFilter<Distance, FixedWidth, T>::MinVecDispersionFilter(
+    const int width, const int k, const int l)
     : k_(k),
       l_(l),
-      width_(width),
-      distances_(width*width),
-      indices_(width*width)
+      window_(width)
 {
     const int N = width*width;
     if (width < 3 || (width % 2) == 0)
@@ -28,86 +65,112 @@ MinVecDispersionFilter::MinVecDispersionFilter(const int width, const int k,
     {
         throw std::runtime_error("'k' and 'l' must be non-zero.");
     }
+
+    AllocateWindow(this->keys_, width);
 }
 
-RGBVector<uint8_t> MinVecDispersionFilter::operator()(const int x, const int y,
-                                                      const cv::Mat &img)
+template<typename Distance, int FixedWidth, typename T>
+RGBVector<T> MinVecDispersionFilter<Distance, FixedWidth, T>::operator()(
+    const int x, const int y, const cv::Mat &img)
 {
-    const internal::ROI window(img, x, y, this->width_);
-    const int width = window.Width();
-    const int height = window.Height();
+    this->window_.MoveTo(img, x, y);
+    const int x_start = this->window_.XStart();
+    const int width = this->window_.XEnd() - x_start + 1;
 
     // Count the number of elements actually added into the window (handle the
     // edges gracefully).
     int N = 0;
 
-    // This is two separate loops: one over all of the pixels in the window and
-    // another to compute the aggregate distances between the current window
-    // pixel and all other pixels.
-    for (int yi = 0; yi < height; yi++)
-        for (int xi = 0; xi < width; xi++)
+    // The sliding window provides the aggregate distance between each window
+    // pixel and all other pixels, so they only need to be collected.  The
+    // (row-major) index is stored alongside the aggregate in each key so that
+    // any ties are broken by their position in the window.
+    this->window_.ForEach(
+        [&](const aggregate_type aggregate, const RGBVector<T> &)
         {
-            // Compute the aggregate distances for the current pixel.
-            const RGBVector<uint8_t> pi(window(xi, yi), img.channels());
-            this->distances_[N] = 0;
-            for (int yj = 0; yj < height; yj++)
-                for (int xj = 0; xj < width; xj++)
-                {
-                    const RGBVector<uint8_t> pj(window(xj, yj), img.channels());
-                    this->distances_[N] += pi.SquaredDistance(pj);
-                }
-
-            // Update the number of distances.
+            this->keys_[N] = MakeKey(aggregate, N);
             N++;
         }
+    );
 
-    // Figure out the order of the distances used an argsort.
-    ArgSort(std::begin(this->distances_), std::begin(this->distances_) + N,
-            std::begin(this->indices_), std::begin(this->indices_) + N);
-
-    // Compute the MVDF output but comparing the set of least similar vectors to
-    // the average of the most similar ones.  First, compute the average of the
+    // Maps a key back to the colour of the pixel it came from.
+    auto colour = [&](const key_type &key)
+    {
+        const int i = KeyIndex(key);
+        return this->window_.Colour(x_start + i % width, i / width);
+    };
+
+    // The window may have been clamped to fewer than 'k' or 'l' pixels.
+    const int l = std::min(this->l_, N);
+    const int k = std::min(this->k_, N);
+    const auto first = std::begin(this->keys_);
+    const auto last = first + N;
+
+    // Only the sets of the 'l' most similar and 'k' least similar vectors are
+    // needed, not their order, so a partial selection is enough.  Compute the
+    // MVDF output but comparing the set of least similar vectors to the
+    // average of the most similar ones.  First, compute the average of the
     // 'l' most similar vectors.
-    uint32_t sum_r = 0;
-    uint32_t sum_g = 0;
-    uint32_t sum_b = 0;
+    std::nth_element(first, first + l - 1, last);
 
-    for (int i = 0; i < this->l_; i++)
+    aggregate_type sum_r = 0;
+    aggregate_type sum_g = 0;
+    aggregate_type sum_b = 0;
+
+    for (int i = 0; i < l; i++)
     {
-        const uint8_t *pixel = window[this->indices_[i]];
-        switch(img.channels())
-        {
-            case 4:
-            case 3:
-                sum_b += pixel[2];
-            case 2:
-                sum_g += pixel[1];
-            case 1:
-                sum_r += pixel[0];
-        }
+        const RGBVector<T> pixel = colour(this->keys_[i]);
+        sum_r += pixel.red;
+        sum_g += pixel.green;
+        sum_b += pixel.blue;
     }
 
-    sum_r /= this->l_;
-    sum_g /= this->l_;
-    sum_b /= this->l_;
+    sum_r /= l;
+    sum_g /= l;
+    sum_b /= l;
 
-    const RGBVector<uint8_t> mean_rgb(std::clamp<uint32_t>(sum_r, 0, 255),
-                                      std::clamp<uint32_t>(sum_g, 0, 255),
-                                      std::clamp<uint32_t>(sum_b, 0, 255));
+    const aggregate_type max = kChannelMax<T>;
+    const RGBVector<T> mean_rgb(std::clamp<aggregate_type>(sum_r, 0, max),
+                                std::clamp<aggregate_type>(sum_g, 0, max),
+                                std::clamp<aggregate_type>(sum_b, 0, max));
+
+    // The 'k' least similar vectors are usually disjoint from the 'l' most
+    // similar ones, so the second selection only needs to look at what's left.
+    if (N - k >= l)
+        std::nth_element(first + l, last - k, last);
+    else
+        std::nth_element(first, last - k, last);
 
     // Now, compare that against the 'k' least similar vectors.
-    int min_dist = kMaxDistanceSq;
-    for (int j = 0; j < this->k_; j++)
+    const Distance distance{};
+    aggregate_type min_dist = Distance::template MaxDistance<T>();
+    for (int j = 0; j < k; j++)
     {
-        const RGBVector<uint8_t> rgb(window[this->indices_[N - j - 1]],
-                                     img.channels());
-        const int sqdist = rgb.SquaredDistance(mean_rgb);
-        min_dist = std::min(sqdist, min_dist);
+        const RGBVector<T> rgb = colour(this->keys_[N - j - 1]);
+        min_dist = std::min(distance(rgb, mean_rgb), min_dist);
     }
 
     // Output is the scaled magnitude between the two extracted vectors.
-    const uint8_t value = 255*std::sqrt(static_cast<double>(min_dist))/kMaxDistance;
-    return RGBVector<uint8_t>(value, value, value);
+    const T value = kChannelMax<T>*Distance::Length(min_dist) /
+                    Distance::template MaxLength<T>();
+    return RGBVector<T>(value, value, value);
 }
 
+// Window widths with specialized filters, for each of the distances and
+// image depths.
+#define CHROMAVEC_INSTANTIATE(Distance, T) \
+template class MinVecDispersionFilter<Distance, kDynamicWidth, T>; \
+template class MinVecDispersionFilter<Distance, 3, T>; \
+template class MinVecDispersionFilter<Distance, 5, T>; \
+template class MinVecDispersionFilter<Distance, 7, T>;
+
+CHROMAVEC_INSTANTIATE(SquaredEuclideanDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(ManhattanDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(ChebyshevDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(SquaredEuclideanDistance, uint16_t)
+CHROMAVEC_INSTANTIATE(ManhattanDistance, uint16_t)
+CHROMAVEC_INSTANTIATE(ChebyshevDistance, uint16_t)
+
+#undef CHROMAVEC_INSTANTIATE
+
 }} // namespace chromavec::internal
@@ -7,21 +7,34 @@
 #define SRC_CHROMAVEC_FILTERS_MINIMUM_VECTOR_DISPERSION_H_
 
 #include <cstdint>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <opencv2/core.hpp>
 
 #include <tbb/cache_aligned_allocator.h>
 
+#include "utilities/distances.h"
 #include "utilities/filter.h"
 #include "utilities/rgbvector.h"
+#include "utilities/pairwise-window.h"
 
 namespace chromavec { namespace internal {
 
 /**
  * @brief Implementation of a Minimum Vector Dispersion Filter.
+ * @tparam Distance
+ *      the distance policy used to compare colours (see distances.h)
+ * @tparam FixedWidth
+ *      the filter window width if it's known at compile time
+ * @tparam T
+ *      the image's channel type, i.e. `uint8_t` or `uint16_t`
  */
-class MinVecDispersionFilter : public OperatorBase<CV_8UC3, CV_8UC3>
+template<typename Distance = SquaredEuclideanDistance,
+         int FixedWidth = kDynamicWidth, typename T = uint8_t>
+class MinVecDispersionFilter : public OperatorBase<RGBImageType<T>::value,
+                                                   RGBImageType<T>::value>
 {
 public:
     /**
@@ -46,17 +59,41 @@ public:
      * @return
      *      output colour
      */
-    RGBVector<uint8_t> operator()(const int x, const int y, const cv::Mat &img);
+    RGBVector<T> operator()(const int x, const int y, const cv::Mat &img);
+
+    /**
+     * @brief The number of pixels the filter reads on either side of a pixel.
+     */
+    int Halo() const { return this->window_.Width()/2; }
+
+    /**
+     * @brief Discard any state carried over from the previous pixel.
+     */
+    void Reset() { this->window_.Invalidate(); }
 
     // Default copy-and-assign
     MinVecDispersionFilter(const MinVecDispersionFilter &) = default;
     MinVecDispersionFilter &operator=(const MinVecDispersionFilter &) = default;
 
 private:
-    const int k_, l_;
-    const int width_;
-    std::vector<int, tbb::cache_aligned_allocator<int>> distances_;
-    std::vector<int, tbb::cache_aligned_allocator<int>> indices_;
+    typedef AggregateWindow<Distance, FixedWidth, T> window_type;
+    typedef typename window_type::aggregate_type aggregate_type;
+
+    /**
+     * The keys are sorted to find the most and least similar vectors.  An
+     * 8-bit aggregate is packed, along with the pixel's index, into a single
+     * integer.  A 16-bit aggregate needs all 64 bits, so it's paired with the
+     * index instead.
+     */
+    typedef std::conditional_t<
+        sizeof(aggregate_type) <= sizeof(int32_t),
+        int64_t,
+        std::pair<aggregate_type, int>
+    > key_type;
+
+    int k_, l_;
+    window_type window_;
+    WindowBuffer<key_type, FixedWidth> keys_;
 };
 
 }} // namespace chromavec::internal
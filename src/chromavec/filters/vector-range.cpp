@@ -7,47 +7,41 @@
 
 #include "utilities/filter.h"
 #include "utilities/functions.h"
-#include "utilities/roi.h"
 
 namespace chromavec { namespace internal {
 
-VectorRangeFilter::VectorRangeFilter(const int width)
-    : width_(width)
+template<typename Distance, int FixedWidth, typename T>
+VectorRangeFilter<Distance, FixedWidth, T>::VectorRangeFilter(const int width)
+    : window_(width)
 {
     if (width < 3 || (width % 2) == 0)
         throw std::runtime_error("Filter width must be odd.");
 }
 
-RGBVector<uint8_t> VectorRangeFilter::operator()(const int x, const int y,
-                                                 const cv::Mat &img)
+template<typename Distance, int FixedWidth, typename T>
+RGBVector<T> VectorRangeFilter<Distance, FixedWidth, T>::operator()(
+    const int x, const int y, const cv::Mat &img)
 {
-    const internal::ROI window(img, x, y, this->width_);
-    const int width = window.Width();
-    const int height = window.Height();
+    typedef typename AggregateWindow<Distance, FixedWidth, T>::aggregate_type
+        aggregate_type;
+
+    this->window_.MoveTo(img, x, y);
+    const int x_start = this->window_.XStart();
+    const int width = this->window_.Width();
 
     // Keep track of the maximum and minimum distances.
-    int min_distance = kMaxDistanceSq*this->width_*this->width_;
-    int max_distance = 0;
+    aggregate_type min_distance =
+        Distance::template MaxDistance<T>()*width*width;
+    aggregate_type max_distance = 0;
 
-    RGBVector<uint8_t> min_colour(window[0], img.channels());
-    RGBVector<uint8_t> max_colour(window[0], img.channels());
+    RGBVector<T> min_colour = this->window_.Colour(x_start, 0);
+    RGBVector<T> max_colour = this->window_.Colour(x_start, 0);
 
-    // This is two separate loops: one over all of the pixels in the window and
-    // another to compute the aggregate distances between the current window
-    // pixel and all other pixels.
-    for (int yi = 0; yi < height; yi++)
-        for (int xi = 0; xi < width; xi++)
+    // The sliding window provides the aggregate distance between each window
+    // pixel and all other pixels, so only a single pass is needed.
+    this->window_.ForEach(
+        [&](const aggregate_type distance, const RGBVector<T> &pi)
         {
-            // Compute the aggregate distances for the current pixel.
-            const RGBVector<uint8_t> pi(window(xi, yi), img.channels());
-            int distance = 0;
-            for (int yj = 0; yj < height; yj++)
-                for (int xj = 0; xj < width; xj++)
-                {
-                    const RGBVector<uint8_t> pj(window(xj, yj), img.channels());
-                    distance += pi.SquaredDistance(pj);
-                }
-
             // Update the minimum/maximum distance values.
             if (distance < min_distance)
             {
@@ -61,12 +55,31 @@ RGBVector<uint8_t> VectorRangeFilter::operator()(const int x, const int y,
                 max_colour = pi;
             }
         }
+    );
 
     // Output is the scaled magnitude between the two extracted vectors.
-    const int sqdist = min_colour.SquaredDistance(max_colour);
-    const uint8_t value = 255*std::sqrt(static_cast<double>(sqdist))/kMaxDistance;
+    const aggregate_type distance = Distance()(min_colour, max_colour);
+    const T value = kChannelMax<T>*Distance::Length(distance) /
+                    Distance::template MaxLength<T>();
 
-    return RGBVector<uint8_t>(value, value, value);
+    return RGBVector<T>(value, value, value);
 }
 
+// Window widths with specialized filters, for each of the distances and
+// image depths.
+#define CHROMAVEC_INSTANTIATE(Distance, T) \
+template class VectorRangeFilter<Distance, kDynamicWidth, T>; \
+template class VectorRangeFilter<Distance, 3, T>; \
+template class VectorRangeFilter<Distance, 5, T>; \
+template class VectorRangeFilter<Distance, 7, T>;
+
+CHROMAVEC_INSTANTIATE(SquaredEuclideanDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(ManhattanDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(ChebyshevDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(SquaredEuclideanDistance, uint16_t)
+CHROMAVEC_INSTANTIATE(ManhattanDistance, uint16_t)
+CHROMAVEC_INSTANTIATE(ChebyshevDistance, uint16_t)
+
+#undef CHROMAVEC_INSTANTIATE
+
 }} // namespace chromavec::internal
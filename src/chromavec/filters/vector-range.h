@@ -8,15 +8,26 @@
 
 #include <tbb/cache_aligned_allocator.h>
 
+#include "utilities/distances.h"
 #include "utilities/filter.h"
 #include "utilities/rgbvector.h"
+#include "utilities/pairwise-window.h"
 
 namespace chromavec { namespace internal {
 
 /**
  * @brief Implementation of a Minimum Vector Dispersion Filter.
+ * @tparam Distance
+ *      the distance policy used to compare colours (see distances.h)
+ * @tparam FixedWidth
+ *      the filter window width if it's known at compile time
+ * @tparam T
+ *      the image's channel type, i.e. `uint8_t` or `uint16_t`
  */
-class VectorRangeFilter : public OperatorBase<CV_8UC3, CV_8UC3>
+template<typename Distance = SquaredEuclideanDistance,
+         int FixedWidth = kDynamicWidth, typename T = uint8_t>
+class VectorRangeFilter : public OperatorBase<RGBImageType<T>::value,
+                                              RGBImageType<T>::value>
 {
 public:
     /**
@@ -37,14 +48,24 @@ public:
      * @return
      *      output colour
      */
-    RGBVector<uint8_t> operator()(const int x, const int y, const cv::Mat &img);
+    RGBVector<T> operator()(const int x, const int y, const cv::Mat &img);
+
+    /**
+     * @brief The number of pixels the filter reads on either side of a pixel.
+     */
+    int Halo() const { return this->window_.Width()/2; }
+
+    /**
+     * @brief Discard any state carried over from the previous pixel.
+     */
+    void Reset() { this->window_.Invalidate(); }
 
     // Default copy-and-assign
     VectorRangeFilter(const VectorRangeFilter &) = default;
     VectorRangeFilter &operator=(const VectorRangeFilter &) = default;
 
 private:
-    const int width_;
+    AggregateWindow<Distance, FixedWidth, T> window_;
 };
 
 }} // namespace chromavec::internal
@@ -6,54 +6,101 @@
 #include "constants.h"
 
 #include "utilities/functions.h"
-#include "utilities/roi.h"
 #include "utilities/rgbvector.h"
 
 namespace chromavec { namespace internal {
 
-VMFilter::VMFilter(const int width)
-    : width_(width)
+template<typename Distance, int FixedWidth, typename T>
+VMFilter<Distance, FixedWidth, T>::VMFilter(const int width)
+    : window_(width)
 {
     if (width < 3 || (width % 2) == 0)
         throw std::runtime_error("Filter width must be odd.");
 }
 
-RGBVector<uint8_t> VMFilter::operator()(const int x, const int y, const cv::Mat &img)
+template<typename Distance, int FixedWidth, typename T>
+RGBVector<T> VMFilter<Distance, FixedWidth, T>::operator()(
+    const int x, const int y, const cv::Mat &img)
 {
-    const internal::ROI window(img, x, y, this->width_);
-    const int width = window.Width();
-    const int height = window.Height();
-
-    RGBVector<uint8_t> best_vector(window(0, 0), img.channels());
-    int minimum_distance = kMaxDistance*this->width_*this->width_;
-
-    // This is two separate loops: one over all of the pixels in the window and
-    // another to compute the aggregate distances between the current window
-    // pixel and all other pixels.
-    for (int yi = 0; yi < height; yi++)
-        for (int xi = 0; xi < width; xi++)
-        {
-            // Compute the aggregate distances for the current pixel.
-            const RGBVector<uint8_t> pi(window(xi, yi), img.channels());
-            int distance = 0;
-            for (int yj = 0; yj < height; yj++)
-                for (int xj = 0; xj < width; xj++)
-                {
-                    const RGBVector<uint8_t> pj(window(xj, yj), img.channels());
-                    distance += pi.SquaredDistance(pj);
-                }
+    typedef typename AggregateWindow<Distance, FixedWidth, T>::aggregate_type
+        aggregate_type;
+
+    // The sliding window only has to update the aggregate distances for the
+    // pixels that entered or left it since the last call.
+    this->window_.MoveTo(img, x, y);
+    const int x_start = this->window_.XStart();
+    const int width = this->window_.Width();
+
+    // The initial distance is scaled along with the distances themselves, so
+    // that a 16-bit image is filtered in the same way as the equivalent 8-bit
+    // image.
+    const aggregate_type scale = Distance::template MaxDistance<T>() /
+                                 Distance::template MaxDistance<uint8_t>();
 
+    RGBVector<T> best_vector = this->window_.Colour(x_start, 0);
+    aggregate_type minimum_distance =
+        scale*Distance::template MaxLength<uint8_t>()*width*width;
+
+    // Search for the pixel with the smallest aggregate distance.  The scan
+    // order is row-major so that ties resolve in the same way as a direct
+    // evaluation over the window.
+    this->window_.ForEach(
+        [&](const aggregate_type distance, const RGBVector<T> &colour)
+        {
             // Check to see if it's the best distance and update if it is.
             if (distance < minimum_distance)
             {
                 minimum_distance = distance;
-                best_vector = pi;
+                best_vector = colour;
             }
         }
+    );
 
     // Output is the magnitude between the least central and most central
     // vectors.
     return best_vector;
 }
 
+HistogramVMFilter::HistogramVMFilter(const int width)
+    : width_(width),
+      window_(width)
+{
+    if (width < 3 || (width % 2) == 0)
+        throw std::runtime_error("Filter width must be odd.");
+}
+
+RGBVector<uint8_t> HistogramVMFilter::operator()(const int x, const int y,
+                                                 const cv::Mat &img)
+{
+    this->window_.MoveTo(img, x, y);
+
+    int minimum_distance = 0;
+    const RGBVector<uint8_t> &median = this->window_.Median(minimum_distance);
+
+    // Match VMFilter, which only accepts a pixel if it beats the initial
+    // distance.
+    const int max_length = SquaredEuclideanDistance::MaxLength<uint8_t>();
+    if (minimum_distance >= max_length*this->width_*this->width_)
+        return this->window_.First();
+
+    return median;
+}
+
+// Window widths with specialized filters, for each of the distances and
+// image depths.
+#define CHROMAVEC_INSTANTIATE(Distance, T) \
+template class VMFilter<Distance, kDynamicWidth, T>; \
+template class VMFilter<Distance, 3, T>; \
+template class VMFilter<Distance, 5, T>; \
+template class VMFilter<Distance, 7, T>;
+
+CHROMAVEC_INSTANTIATE(SquaredEuclideanDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(ManhattanDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(ChebyshevDistance, uint8_t)
+CHROMAVEC_INSTANTIATE(SquaredEuclideanDistance, uint16_t)
+CHROMAVEC_INSTANTIATE(ManhattanDistance, uint16_t)
+CHROMAVEC_INSTANTIATE(ChebyshevDistance, uint16_t)
+
+#undef CHROMAVEC_INSTANTIATE
+
 }} // namespace chromavec::internal
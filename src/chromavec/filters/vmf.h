@@ -6,15 +6,27 @@
 
 #include <opencv2/core.hpp>
 
+#include "utilities/colour-histogram.h"
+#include "utilities/distances.h"
 #include "utilities/filter.h"
 #include "utilities/rgbvector.h"
+#include "utilities/pairwise-window.h"
 
 namespace chromavec { namespace internal {
 
 /**
  * @brief Implementation of a Minimum Vector Dispersion Filter.
+ * @tparam Distance
+ *      the distance policy used to compare colours (see distances.h)
+ * @tparam FixedWidth
+ *      the filter window width if it's known at compile time
+ * @tparam T
+ *      the image's channel type, i.e. `uint8_t` or `uint16_t`
  */
-class VMFilter : public OperatorBase<CV_8UC3, CV_8UC3>
+template<typename Distance = SquaredEuclideanDistance,
+         int FixedWidth = kDynamicWidth, typename T = uint8_t>
+class VMFilter : public OperatorBase<RGBImageType<T>::value,
+                                     RGBImageType<T>::value>
 {
 public:
     /**
@@ -35,14 +47,74 @@ public:
      * @return
      *      output colour
      */
-    RGBVector<uint8_t> operator()(const int x, const int y, const cv::Mat &img);
+    RGBVector<T> operator()(const int x, const int y, const cv::Mat &img);
+
+    /**
+     * @brief The number of pixels the filter reads on either side of a pixel.
+     */
+    int Halo() const { return this->window_.Width()/2; }
+
+    /**
+     * @brief Discard any state carried over from the previous pixel.
+     */
+    void Reset() { this->window_.Invalidate(); }
 
     // Default copy-and-assign
     VMFilter(const VMFilter &) = default;
     VMFilter &operator=(const VMFilter &) = default;
 
 private:
-    const int width_;
+    AggregateWindow<Distance, FixedWidth, T> window_;
+};
+
+/**
+ * The histogram-based filter produces exactly the same output as VMFilter but
+ * searches the window through a SlidingColourHistogram.  It is faster for
+ * large windows since the search cost depends on the number of distinct
+ * colours rather than the number of pixels.
+ *
+ * @brief Implementation of a Vector Median Filter using a colour histogram.
+ */
+class HistogramVMFilter : public OperatorBase<CV_8UC3, CV_8UC3>
+{
+public:
+    /**
+     * @brief Construct a new filter object.
+     * @param width
+     *      filter window width
+     * @raises std::runtime_error
+     *      if the window width is not an odd value
+     */
+    HistogramVMFilter(const int width);
+
+    /**
+     * @brief Override of the '()' operator.
+     * @param x, y
+     *      the current pixel
+     * @param img
+     *      image being processed
+     * @return
+     *      output colour
+     */
+    RGBVector<uint8_t> operator()(const int x, const int y, const cv::Mat &img);
+
+    /**
+     * @brief The number of pixels the filter reads on either side of a pixel.
+     */
+    int Halo() const { return this->width_/2; }
+
+    /**
+     * @brief Discard any state carried over from the previous pixel.
+     */
+    void Reset() { this->window_.Invalidate(); }
+
+    // Default copy-and-assign
+    HistogramVMFilter(const HistogramVMFilter &) = default;
+    HistogramVMFilter &operator=(const HistogramVMFilter &) = default;
+
+private:
+    int width_;
+    SlidingColourHistogram window_;
 };
 
 }} // namespace chromavec::internal
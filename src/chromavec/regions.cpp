@@ -0,0 +1,111 @@
+#include "chromavec/chromavec.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace chromavec {
+
+// Internal functions
+namespace {
+
+/**
+ * A region is usually smaller than the images already in the workspace.
+ * Handing the filter a view of the buffer's top-left corner means that its
+ * `create()` call is a no-op, instead of reallocating the buffer to the size
+ * of the region.  Buffers that are too small are grown first, so that they
+ * fit every region seen so far.
+ *
+ * @brief Obtain a view of a workspace buffer with the given size.
+ * @param buffer
+ *      the workspace buffer; left empty if it hasn't been allocated yet
+ * @param size
+ *      size of the view
+ * @return
+ *      the view, or an empty matrix if the buffer is empty
+ */
+cv::Mat View(cv::Mat &buffer, const cv::Size &size)
+{
+    if (buffer.empty())
+        return cv::Mat();
+
+    if (buffer.rows < size.height || buffer.cols < size.width)
+    {
+        buffer.create(std::max(buffer.rows, size.height),
+                      std::max(buffer.cols, size.width), buffer.type());
+    }
+
+    return buffer(cv::Rect(cv::Point(0, 0), size));
+}
+
+/**
+ * @brief Put a workspace buffer back after filtering into a view of it.
+ * @param buffer
+ *      the workspace buffer, which currently holds the view
+ * @param original
+ *      the buffer the view was taken from
+ */
+void Restore(cv::Mat &buffer, cv::Mat &original)
+{
+    // If the filter needed a different type, it will have replaced the view
+    // with a new buffer, which is kept instead.
+    if (buffer.empty() || buffer.datastart == original.datastart)
+        buffer = std::move(original);
+}
+
+} // end of anonymous namespace
+
+void ApplyFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                 const FilterSpec &spec, const cv::Rect &region)
+{
+    const cv::Rect bounds(0, 0, img.cols, img.rows);
+    const cv::Rect target = region & bounds;
+    if (target.area() == 0)
+        return;
+
+    // Filter the region along with the pixels around it that the filter
+    // reads.  Those are only clamped at the edges of the image itself.
+    const int halo = FilterHalo(spec, img.depth());
+    const cv::Rect source = cv::Rect(target.x - halo, target.y - halo,
+                                     target.width + 2*halo,
+                                     target.height + 2*halo)
+                            & bounds;
+
+    // The filter runs on views of the workspace images, so regions of
+    // different sizes share them rather than each reallocating them.
+    cv::Mat gradient = View(workspace.gradient, source.size());
+    cv::Mat classes = View(workspace.classes, source.size());
+    cv::Mat hsv = View(workspace.hsv, source.size());
+    cv::Mat filtered = View(workspace.region, source.size());
+    std::swap(gradient, workspace.gradient);
+    std::swap(classes, workspace.classes);
+    std::swap(hsv, workspace.hsv);
+
+    ApplyFilter(img(source), filtered, workspace, spec);
+
+    Restore(workspace.gradient, gradient);
+    Restore(workspace.classes, classes);
+    Restore(workspace.hsv, hsv);
+    if (filtered.datastart != workspace.region.datastart)
+        workspace.region = filtered;
+
+    // A newly allocated output starts out black, rather than with whatever
+    // happened to be in memory, everywhere outside of the regions.
+    if (out.size() != img.size() || out.type() != filtered.type())
+    {
+        out.create(img.rows, img.cols, filtered.type());
+        out.setTo(cv::Scalar::all(0));
+    }
+
+    cv::Mat dst = out(target);
+    filtered(cv::Rect(target.x - source.x, target.y - source.y, target.width,
+                      target.height)).copyTo(dst);
+}
+
+void ApplyFilter(const cv::Mat &img, cv::Mat &out, Workspace &workspace,
+                 const FilterSpec &spec, const std::vector<cv::Rect> &regions)
+{
+    for (const cv::Rect &region : regions)
+        ApplyFilter(img, out, workspace, spec, region);
+}
+
+} // namespace chromavec
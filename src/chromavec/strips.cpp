@@ -0,0 +1,91 @@
+#include "chromavec/chromavec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace chromavec {
+
+void FilterStrips(const FilterSpec &spec, const cv::Size &size,
+                  const RowSource &source, const RowSink &sink,
+                  const int strip_rows, const int type)
+{
+    if (strip_rows < 1)
+        throw std::runtime_error("Strip size must be positive.");
+    if (type != CV_8UC3 && type != CV_16UC3)
+        throw std::runtime_error("Input type not supported by this filter.");
+
+    const int halo = FilterHalo(spec, CV_MAT_DEPTH(type));
+
+    // The input buffer holds a strip's output rows plus the halo on either
+    // side of it.
+    cv::Mat buffer(std::min(strip_rows + 2*halo, size.height), size.width,
+                   type);
+    const size_t row_bytes = buffer.cols*buffer.elemSize();
+
+    Workspace workspace;
+    cv::Mat out;
+
+    // The image rows that are currently in the buffer.
+    int loaded_start = 0;
+    int loaded_end = 0;
+
+    for (int y = 0; y < size.height; y += strip_rows)
+    {
+        const int y_end = std::min(y + strip_rows, size.height);
+        const int in_start = std::max(y - halo, 0);
+        const int in_end = std::min(y_end + halo, size.height);
+
+        // The bottom of the previous strip overlaps with the top of this one,
+        // so move those rows up rather than reading them again.
+        const int kept = loaded_end - in_start;
+        const int shift = in_start - loaded_start;
+        if (shift > 0)
+        {
+            for (int i = 0; i < kept; i++)
+                std::memcpy(buffer.ptr(i), buffer.ptr(i + shift), row_bytes);
+        }
+
+        // Read in the rest of the strip.
+        if (in_end > loaded_end)
+        {
+            cv::Mat rows = buffer.rowRange(kept, in_end - in_start);
+            const uint8_t *data = rows.data;
+
+            source(loaded_end, rows);
+            if (rows.data != data)
+                throw std::runtime_error("Row source didn't fill in the rows "
+                                         "it was given.");
+        }
+
+        loaded_start = in_start;
+        loaded_end = in_end;
+
+        // Filter the strip and only pass along the rows that have their full
+        // halo.
+        ApplyFilter(buffer.rowRange(0, in_end - in_start), out, workspace,
+                    spec);
+        sink(y, out.rowRange(y - in_start, y_end - in_start));
+    }
+}
+
+RowSource ImageRowSource(const cv::Mat &img)
+{
+    return [&img](const int y, cv::Mat &rows)
+    {
+        img.rowRange(y, y + rows.rows).copyTo(rows);
+    };
+}
+
+RowSink ImageRowSink(cv::Mat &img, const cv::Size &size)
+{
+    return [&img, size](const int y, const cv::Mat &rows)
+    {
+        img.create(size, rows.type());
+
+        cv::Mat dst = img.rowRange(y, y + rows.rows);
+        rows.copyTo(dst);
+    };
+}
+
+} // namespace chromavec
@@ -0,0 +1,345 @@
+#include "colour-histogram.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+
+#include "constants.h"
+
+namespace chromavec { namespace internal {
+
+namespace {
+
+constexpr int kBucketBits = 4;
+constexpr int kBucketShift = 8 - kBucketBits;
+constexpr int kBucketSize = 1 << kBucketShift;
+constexpr int kBucketMask = (1 << kBucketBits) - 1;
+constexpr int kNumBuckets = 1 << (3*kBucketBits);
+
+// Windows with more occupied buckets than this use the shell search.
+constexpr int kListSearchBuckets = 64;
+
+/**
+ * @brief Determine which bucket a colour falls into.
+ */
+inline int Bucket(const RGBVector<uint8_t> &p)
+{
+    return ((p.red >> kBucketShift) << (2*kBucketBits)) |
+           ((p.green >> kBucketShift) << kBucketBits) |
+           (p.blue >> kBucketShift);
+}
+
+/**
+ * @brief Squared distance between N*c and the colour sum for one channel.
+ */
+inline int64_t ChannelDistance(const int64_t n, const int64_t c,
+                               const int64_t sum)
+{
+    const int64_t d = n*c - sum;
+    return d*d;
+}
+
+/**
+ * @brief Lower bound on the distance between N*c and the colour sum, where
+ *      'c' is anywhere within a bucket, for one channel.
+ */
+inline int64_t ChannelBound(const int64_t n, const int index,
+                            const int64_t sum)
+{
+    const int64_t lo = n*(index << kBucketShift);
+    const int64_t hi = n*((index << kBucketShift) + kBucketSize - 1);
+    if (sum < lo)
+        return (lo - sum)*(lo - sum);
+    if (sum > hi)
+        return (sum - hi)*(sum - hi);
+    return 0;
+}
+
+} // end of anonymous namespace
+
+SlidingColourHistogram::SlidingColourHistogram(const int width)
+    : width_(width),
+      x_(-1),
+      y_(-1),
+      x_start_(0),
+      x_end_(-1),
+      y_start_(0),
+      height_(0),
+      colours_(width*width),
+      sum_r_(0),
+      sum_g_(0),
+      sum_b_(0),
+      sum_sq_(0),
+      bucket_(width*width),
+      next_(width*width),
+      prev_(width*width),
+      head_(kNumBuckets, -1),
+      position_(kNumBuckets, -1)
+{
+    if (width < 1)
+        throw std::runtime_error("Window width must be positive.");
+
+    // The sums and the aggregate are kept in an 'int', just like
+    // SlidingAggregateDistances.
+    const int64_t count = static_cast<int64_t>(width)*width;
+    if (count > std::numeric_limits<int>::max() / kMaxColourDistanceSq<uint8_t>)
+        throw std::runtime_error("Window width is too large.");
+
+    this->occupied_.reserve(width*width);
+}
+
+void SlidingColourHistogram::MoveTo(const cv::Mat &img, const int x,
+                                    const int y)
+{
+    const int half = this->width_/2;
+    const int x_start = std::clamp(x - half, 0, img.cols-1);
+    const int x_end = std::clamp(x + half, 0, img.cols-1);
+
+    if (y == this->y_ && x == this->x_ + 1)
+    {
+        while (this->x_start_ < x_start)
+            this->RemoveColumn(this->x_start_);
+
+        while (this->x_end_ < x_end)
+            this->AddColumn(img, this->x_end_ + 1);
+    }
+    else
+    {
+        const int y_start = std::clamp(y - half, 0, img.rows-1);
+        const int y_end = std::clamp(y + half, 0, img.rows-1);
+
+        this->Reset();
+        this->y_start_ = y_start;
+        this->height_ = y_end - y_start + 1;
+        this->x_start_ = x_start;
+        this->x_end_ = x_start - 1;
+
+        for (int xi = x_start; xi <= x_end; xi++)
+            this->AddColumn(img, xi);
+    }
+
+    this->x_ = x;
+    this->y_ = y;
+}
+
+const RGBVector<uint8_t> &SlidingColourHistogram::Median(int &aggregate) const
+{
+    const int64_t n = (this->x_end_ - this->x_start_ + 1)*this->height_;
+
+    int64_t best_distance = std::numeric_limits<int64_t>::max();
+    int best_order = std::numeric_limits<int>::max();
+    int best_slot = -1;
+
+    // Check every pixel in a bucket against the current best.
+    auto search = [&](const int bucket)
+    {
+        for (int slot = this->head_[bucket]; slot != -1;
+             slot = this->next_[slot])
+        {
+            const RGBVector<uint8_t> &p = this->colours_[slot];
+            const int64_t distance = ChannelDistance(n, p.red, this->sum_r_) +
+                                     ChannelDistance(n, p.green, this->sum_g_) +
+                                     ChannelDistance(n, p.blue, this->sum_b_);
+            if (distance > best_distance)
+                continue;
+
+            const int order = this->Order(slot);
+            if (distance < best_distance || order < best_order)
+            {
+                best_distance = distance;
+                best_order = order;
+                best_slot = slot;
+            }
+        }
+    };
+
+    // Only look inside of a bucket if it could contain something that's at
+    // least as good as the current best.
+    auto visit = [&](const int bucket)
+    {
+        const int64_t bound =
+            ChannelBound(n, bucket >> (2*kBucketBits), this->sum_r_) +
+            ChannelBound(n, (bucket >> kBucketBits) & kBucketMask,
+                         this->sum_g_) +
+            ChannelBound(n, bucket & kBucketMask, this->sum_b_);
+
+        if (bound <= best_distance)
+            search(bucket);
+    };
+
+    // Start with the bucket that contains the mean since it's the most likely
+    // to hold the median.
+    const int mean_r = (this->sum_r_/n) >> kBucketShift;
+    const int mean_g = (this->sum_g_/n) >> kBucketShift;
+    const int mean_b = (this->sum_b_/n) >> kBucketShift;
+    const int mean_bucket = (mean_r << (2*kBucketBits)) |
+                            (mean_g << kBucketBits) | mean_b;
+    search(mean_bucket);
+
+    if (static_cast<int>(this->occupied_.size()) <= kListSearchBuckets)
+    {
+        // Few colours, so just check all of them.
+        for (const int bucket : this->occupied_)
+            if (bucket != mean_bucket)
+                visit(bucket);
+    }
+    else
+    {
+        // Many colours, so search outwards from the mean one shell of buckets
+        // at a time.  Every pixel in shell 'r' is more than (r-1) bucket
+        // widths away from the mean along at least one channel, which means
+        // the search can stop once that is worse than the current best.
+        for (int r = 1; r <= kBucketMask; r++)
+        {
+            const int64_t gap = n*(r - 1)*kBucketSize;
+            if (gap*gap > best_distance)
+                break;
+
+            const int r0 = std::max(mean_r - r, 0);
+            const int r1 = std::min(mean_r + r, kBucketMask);
+            const int g0 = std::max(mean_g - r, 0);
+            const int g1 = std::min(mean_g + r, kBucketMask);
+            const int b0 = std::max(mean_b - r, 0);
+            const int b1 = std::min(mean_b + r, kBucketMask);
+
+            for (int i = r0; i <= r1; i++)
+                for (int j = g0; j <= g1; j++)
+                {
+                    const int base = (i << (2*kBucketBits)) | (j << kBucketBits);
+
+                    // Interior rows of the shell only have their two ends.
+                    const bool face = std::abs(i - mean_r) == r ||
+                                      std::abs(j - mean_g) == r;
+                    const int step = face ? 1 : 2*r;
+
+                    for (int k = face ? b0 : mean_b - r; k <= b1; k += step)
+                        if (k >= b0 && this->head_[base | k] != -1)
+                            visit(base | k);
+                }
+        }
+    }
+
+    const RGBVector<uint8_t> &p = this->colours_[best_slot];
+    const int dot = p.red*this->sum_r_ + p.green*this->sum_g_ +
+                    p.blue*this->sum_b_;
+    aggregate = n*p.SquaredMagnitude() - 2*dot + this->sum_sq_;
+    return p;
+}
+
+int SlidingColourHistogram::Order(const int slot) const
+{
+    // Recover the image column from the slot's column index.
+    const int column = slot / this->width_;
+    const int yi = slot % this->width_;
+    const int offset = (column - this->x_start_ % this->width_ + this->width_)
+                       % this->width_;
+    const int columns = this->x_end_ - this->x_start_ + 1;
+    return yi*columns + offset;
+}
+
+void SlidingColourHistogram::AddColumn(const cv::Mat &img, const int x)
+{
+    const int base = this->Slot(x, 0);
+
+    for (int k = 0; k < this->height_; k++)
+    {
+        const RGBVector<uint8_t> p(img, x, this->y_start_ + k);
+        this->colours_[base + k] = p;
+        this->Insert(base + k);
+
+        this->sum_r_ += p.red;
+        this->sum_g_ += p.green;
+        this->sum_b_ += p.blue;
+        this->sum_sq_ += p.SquaredMagnitude();
+    }
+
+    this->x_end_ = x;
+}
+
+void SlidingColourHistogram::RemoveColumn(const int x)
+{
+    const int base = this->Slot(x, 0);
+
+    for (int k = 0; k < this->height_; k++)
+    {
+        const RGBVector<uint8_t> &p = this->colours_[base + k];
+        this->Erase(base + k);
+
+        this->sum_r_ -= p.red;
+        this->sum_g_ -= p.green;
+        this->sum_b_ -= p.blue;
+        this->sum_sq_ -= p.SquaredMagnitude();
+    }
+
+    this->x_start_ = x + 1;
+}
+
+void SlidingColourHistogram::Reset()
+{
+    for (const int bucket : this->occupied_)
+    {
+        this->head_[bucket] = -1;
+        this->position_[bucket] = -1;
+    }
+    this->occupied_.clear();
+
+    this->sum_r_ = 0;
+    this->sum_g_ = 0;
+    this->sum_b_ = 0;
+    this->sum_sq_ = 0;
+}
+
+void SlidingColourHistogram::Insert(const int slot)
+{
+    const int bucket = Bucket(this->colours_[slot]);
+    const int head = this->head_[bucket];
+
+    if (head == -1)
+    {
+        this->position_[bucket] = this->occupied_.size();
+        this->occupied_.push_back(bucket);
+    }
+    else
+    {
+        this->prev_[head] = slot;
+    }
+
+    this->bucket_[slot] = bucket;
+    this->next_[slot] = head;
+    this->prev_[slot] = -1;
+    this->head_[bucket] = slot;
+}
+
+void SlidingColourHistogram::Erase(const int slot)
+{
+    const int bucket = this->bucket_[slot];
+    const int next = this->next_[slot];
+    const int prev = this->prev_[slot];
+
+    if (next != -1)
+        this->prev_[next] = prev;
+
+    if (prev != -1)
+    {
+        this->next_[prev] = next;
+    }
+    else
+    {
+        this->head_[bucket] = next;
+
+        // Remove the bucket from the occupied set once it's empty.
+        if (next == -1)
+        {
+            const int position = this->position_[bucket];
+            const int last = this->occupied_.back();
+            this->occupied_[position] = last;
+            this->position_[last] = position;
+            this->occupied_.pop_back();
+            this->position_[bucket] = -1;
+        }
+    }
+}
+
+}} // namespace chromavec::internal
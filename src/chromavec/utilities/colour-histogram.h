@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @brief A sliding colour histogram used to search a window for its vector
+ *      median.
+ */
+#ifndef SRC_CHROMAVEC_UTILITIES_COLOUR_HISTOGRAM_H_
+#define SRC_CHROMAVEC_UTILITIES_COLOUR_HISTOGRAM_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include "rgbvector.h"
+
+namespace chromavec { namespace internal {
+
+/**
+ * The aggregate distance of a colour `c` in a window with N pixels can be
+ * rewritten as
+ *
+ *      sum_j |c - p_j|^2 = |N*c - S|^2/N + (Q - |S|^2/N)
+ *
+ * where S is the sum of the colours and Q is the sum of their squared norms
+ * (see SlidingAggregateDistances).  The vector median is therefore the window
+ * pixel that is closest to the window mean, S/N, and finding it is a nearest
+ * neighbour search.
+ *
+ * The SlidingColourHistogram buckets the window pixels by their colour, using
+ * the upper bits of each channel.  Each bucket covers a box in RGB space, so
+ * the distance between the mean and any pixel in that bucket has a lower
+ * bound.  The search only has to look at the pixels in the buckets where that
+ * bound is no worse than the best pixel found so far.  The cost of a search
+ * then scales with the number of distinct colours in the window rather than
+ * the number of pixels; flat regions collapse into a handful of buckets.
+ *
+ * The search is exact.  Ties are resolved in favour of the first pixel in
+ * row-major order, so the result is identical to a direct search over the
+ * window.
+ *
+ * The window slides in the same way as SlidingAggregateDistances and is
+ * clamped to the image bounds.
+ *
+ * @brief Sliding colour histogram used to find the vector median of a window.
+ */
+class SlidingColourHistogram
+{
+public:
+    /**
+     * @brief Construct a new sliding window.
+     * @param width
+     *      width and height of the window
+     * @throws std::runtime_error
+     *      if the aggregates for the width don't fit in an int
+     */
+    SlidingColourHistogram(const int width);
+
+    /**
+     * @brief Move the window so that it is centred on the given pixel.
+     * @param img
+     *      image being processed
+     * @param x, y
+     *      the centre of the window
+     */
+    void MoveTo(const cv::Mat &img, const int x, const int y);
+
+    /**
+     * @brief Forget the window's position so that the next move rebuilds it.
+     * @note Must be called if the contents of the image being processed
+     *      change between moves.
+     */
+    void Invalidate()
+    {
+        this->x_ = -1;
+        this->y_ = -1;
+    }
+
+    /**
+     * @brief Find the window pixel with the smallest aggregate distance.
+     * @param [out] aggregate
+     *      the aggregate distance of that pixel
+     * @return
+     *      the pixel's colour
+     */
+    const RGBVector<uint8_t> &Median(int &aggregate) const;
+
+    /**
+     * @brief Obtain the first pixel in the window (in row-major order).
+     */
+    const RGBVector<uint8_t> &First() const
+    {
+        return this->colours_[this->Slot(this->x_start_, 0)];
+    }
+
+    // Default copy-and-assign
+    SlidingColourHistogram(const SlidingColourHistogram &) = default;
+    SlidingColourHistogram &operator=(const SlidingColourHistogram &) = default;
+
+private:
+    int Slot(const int x, const int yi) const
+    {
+        return (x % this->width_)*this->width_ + yi;
+    }
+
+    int Order(const int slot) const;
+
+    void AddColumn(const cv::Mat &img, const int x);
+    void RemoveColumn(const int x);
+    void Reset();
+
+    void Insert(const int slot);
+    void Erase(const int slot);
+
+    typedef std::vector<int, tbb::cache_aligned_allocator<int>> IndexList;
+
+    int width_;
+    int x_, y_;
+    int x_start_, x_end_;
+    int y_start_, height_;
+
+    std::vector<RGBVector<uint8_t>, tbb::cache_aligned_allocator<RGBVector<uint8_t>>> colours_;
+    int sum_r_, sum_g_, sum_b_;
+    int sum_sq_;
+
+    // Per-slot bucket and links to the other pixels in the same bucket.
+    IndexList bucket_;
+    IndexList next_;
+    IndexList prev_;
+
+    // Per-bucket list of pixels and the (unordered) set of occupied buckets.
+    IndexList head_;
+    IndexList position_;
+    IndexList occupied_;
+};
+
+}} // namespace chromavec::internal
+
+#endif // SRC_CHROMAVEC_UTILITIES_COLOUR_HISTOGRAM_H_
@@ -0,0 +1,196 @@
+/**
+ * @file
+ * @brief Distance policies used to compare the colours in a filter window.
+ */
+#ifndef SRC_CHROMAVEC_UTILITIES_DISTANCES_H_
+#define SRC_CHROMAVEC_UTILITIES_DISTANCES_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "chromavec/chromavec.h"
+
+#include "constants.h"
+#include "rgbvector.h"
+
+namespace chromavec { namespace internal {
+
+/**
+ * The filters are templated on a distance policy, which is a small function
+ * object with the following members:
+ *
+ *      template<typename T>
+ *      MagType<T>::type operator()(const RGBVector<T> &a, const RGBVector<T> &b) const;
+ *      template<typename D>
+ *      static D FromDifferences(const D dr, const D dg, const D db);
+ *      template<typename D>
+ *      static double Length(const D distance);
+ *      template<typename T>
+ *      static constexpr MagType<T>::type MaxDistance();
+ *      template<typename T>
+ *      static constexpr int MaxLength();
+ *      static constexpr bool closed_form;
+ *
+ * `operator()` is the distance used to rank the colours in a window.  It
+ * doesn't need to be a proper metric; the squared Euclidean distance isn't.
+ * The distance is returned in the colour type's magnitude type (see MagType),
+ * so it can't overflow for 16-bit colours.  `FromDifferences()` computes the
+ * same distance from the per-channel differences, which is how it's evaluated
+ * on planar data (see WindowPlanes).  The differences must already have a type
+ * that is wide enough for the result.  `Length()` converts a distance into a
+ * length along the colour axis, which is what gets displayed.
+ * `MaxDistance()` and `MaxLength()` are the largest possible distance and
+ * length between two colours with channel type `T`.  `closed_form` indicates
+ * that the window aggregates can be computed with SlidingAggregateDistances
+ * rather than from all of the pairwise distances.
+ *
+ * @brief The squared Euclidean (L2) distance.
+ */
+struct SquaredEuclideanDistance
+{
+    static constexpr bool closed_form = true;
+
+    template<typename T>
+    static constexpr typename MagType<T>::type MaxDistance()
+    {
+        return kMaxColourDistanceSq<T>;
+    }
+
+    template<typename T>
+    static constexpr int MaxLength()
+    {
+        return kMaxColourDistance<T>;
+    }
+
+    template<typename T>
+    typename MagType<T>::type operator()(const RGBVector<T> &a,
+                                         const RGBVector<T> &b) const
+    {
+        return a.SquaredDistance(b);
+    }
+
+    template<typename D>
+    static D FromDifferences(const D dr, const D dg, const D db)
+    {
+        return dr*dr + dg*dg + db*db;
+    }
+
+    template<typename D>
+    static double Length(const D distance)
+    {
+        return std::sqrt(static_cast<double>(distance));
+    }
+};
+
+/**
+ * @brief The Manhattan (L1) distance.
+ */
+struct ManhattanDistance
+{
+    static constexpr bool closed_form = false;
+
+    template<typename T>
+    static constexpr typename MagType<T>::type MaxDistance()
+    {
+        return 3*kChannelMax<T>;
+    }
+
+    template<typename T>
+    static constexpr int MaxLength()
+    {
+        return 3*kChannelMax<T>;
+    }
+
+    template<typename T>
+    typename MagType<T>::type operator()(const RGBVector<T> &a,
+                                         const RGBVector<T> &b) const
+    {
+        return a.AbsoluteDistance(b);
+    }
+
+    template<typename D>
+    static D FromDifferences(const D dr, const D dg, const D db)
+    {
+        return std::abs(dr) + std::abs(dg) + std::abs(db);
+    }
+
+    template<typename D>
+    static double Length(const D distance)
+    {
+        return distance;
+    }
+};
+
+/**
+ * @brief The Chebyshev (L-infinity) distance.
+ */
+struct ChebyshevDistance
+{
+    static constexpr bool closed_form = false;
+
+    template<typename T>
+    static constexpr typename MagType<T>::type MaxDistance()
+    {
+        return kChannelMax<T>;
+    }
+
+    template<typename T>
+    static constexpr int MaxLength()
+    {
+        return kChannelMax<T>;
+    }
+
+    template<typename T>
+    typename MagType<T>::type operator()(const RGBVector<T> &a,
+                                         const RGBVector<T> &b) const
+    {
+        return a.MaximumDistance(b);
+    }
+
+    template<typename D>
+    static D FromDifferences(const D dr, const D dg, const D db)
+    {
+        return std::max(std::abs(dr), std::max(std::abs(dg), std::abs(db)));
+    }
+
+    template<typename D>
+    static double Length(const D distance)
+    {
+        return distance;
+    }
+};
+
+/**
+ * @brief Call a function with the distance policy for a metric.
+ * @param metric
+ *      the requested distance metric
+ * @param func
+ *      generic function called with a default-constructed distance policy
+ * @throws std::runtime_error
+ *      if the metric isn't known
+ */
+template<typename Function>
+void WithDistance(const DistanceMetric metric, Function &&func)
+{
+    switch (metric)
+    {
+        case kEuclidean:
+            func(SquaredEuclideanDistance());
+            break;
+        case kManhattan:
+            func(ManhattanDistance());
+            break;
+        case kChebyshev:
+            func(ChebyshevDistance());
+            break;
+        default:
+            throw std::runtime_error("Unknown distance metric.");
+    }
+}
+
+}} // namespace chromavec::internal
+
+#endif // SRC_CHROMAVEC_UTILITIES_DISTANCES_H_
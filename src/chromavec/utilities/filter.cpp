@@ -0,0 +1,94 @@
+#include "filter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <unistd.h>
+
+#include <tbb/task_arena.h>
+
+namespace chromavec { namespace internal {
+
+namespace {
+
+/**
+ * @brief Cache size used when it can't be queried from the system.
+ */
+constexpr int kDefaultCacheSize = 256*1024;
+
+/**
+ * @brief Tile widths are rounded up to a multiple of this many pixels.
+ */
+constexpr int kTileAlignment = 16;
+
+/**
+ * @brief Smallest tile height or width that the automatic layout will use.
+ */
+constexpr int kMinTileSize = 16;
+
+/**
+ * @brief The number of tiles, per worker, that the automatic layout aims for.
+ */
+constexpr int kTilesPerWorker = 4;
+
+int NumTiles(const cv::Size &size, const int rows, const int cols)
+{
+    return ((size.height + rows - 1) / rows) * ((size.width + cols - 1) / cols);
+}
+
+} // end of anonymous namespace
+
+int CacheSize()
+{
+    static const int size = []()
+    {
+        long bytes = -1;
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+        bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        return bytes > 0 ? static_cast<int>(bytes) : kDefaultCacheSize;
+    }();
+
+    return size;
+}
+
+TileLayout AutoTileLayout(const cv::Size &size, const int halo,
+                          const int pixel_bytes)
+{
+    const int pixels = (CacheSize() / 2) / std::max(pixel_bytes, 1);
+
+    // Start with the largest square tile that, with its halo, fits into the
+    // cache budget.
+    const int side = std::max(
+        static_cast<int>(std::sqrt(static_cast<double>(pixels))) - 2*halo,
+        kMinTileSize
+    );
+
+    TileLayout layout;
+    layout.cols = ((side + kTileAlignment - 1) / kTileAlignment)*kTileAlignment;
+    layout.rows = side;
+
+    // If a tile would be wider than the image then it might as well cover the
+    // full width, which leaves more of the budget for the rows.
+    if (layout.cols >= size.width)
+    {
+        layout.cols = std::max(size.width, 1);
+        layout.rows = std::max(pixels / (layout.cols + 2*halo) - 2*halo,
+                               kMinTileSize);
+    }
+
+    layout.rows = std::max(std::min(layout.rows, size.height), 1);
+
+    // Make sure that there are enough tiles to keep all of the workers busy,
+    // even if it means using smaller ones.
+    const int target = kTilesPerWorker*tbb::this_task_arena::max_concurrency();
+    while (layout.rows > kMinTileSize &&
+           NumTiles(size, layout.rows, layout.cols) < target)
+    {
+        layout.rows = std::max(layout.rows / 2, kMinTileSize);
+    }
+
+    return layout;
+}
+
+}} // namespace chromavec::internal
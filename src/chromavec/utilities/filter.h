@@ -6,17 +6,22 @@
 #ifndef SRC_CHROMAVEC_UTILITIES_FILTER_H_
 #define SRC_CHROMAVEC_UTILITIES_FILTER_H_
 
+#include <algorithm>
+#include <any>
 #include <cstdint>
-#include <functional>
+#include <cstring>
 #include <stdexcept>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <opencv2/core.hpp>
 
 #include <tbb/blocked_range2d.h>
-#include <tbb/blocked_range3d.h>
 #include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
 
 #include "rgbvector.h"
 
@@ -42,6 +47,8 @@ struct OpenCVTypeInfo<OcvType> \
 
 CHROMAVEC_DEFINE_TYPE(CV_8UC1, uint8_t, 1)  ///< 8-bit, single channel
 CHROMAVEC_DEFINE_TYPE(CV_8UC3, uint8_t, 3)  ///< 8-bit, three channel
+CHROMAVEC_DEFINE_TYPE(CV_16UC1, uint16_t, 1)    ///< 16-bit unsigned integer, single channel
+CHROMAVEC_DEFINE_TYPE(CV_16UC3, uint16_t, 3)    ///< 16-bit unsigned integer, three channels
 CHROMAVEC_DEFINE_TYPE(CV_32SC1, int32_t, 1)     ///< 32-bit signed integer, single channel
 CHROMAVEC_DEFINE_TYPE(CV_32SC3, int32_t, 3)     ///< 32-bit signed integer, three channels
 CHROMAVEC_DEFINE_TYPE(CV_32FC1, float, 1)   ///< 32-bit floating point, single channel
@@ -49,6 +56,52 @@ CHROMAVEC_DEFINE_TYPE(CV_32FC3, float, 3)   ///< 32-bit floating point, three ch
 
 #undef CHROMAVEC_DEFINE_TYPE
 
+/**
+ * This is the inverse of OpenCVTypeInfo for the colour images that the
+ * filters accept.  The filters are templated on the channel type and use this
+ * to declare their input type.
+ *
+ * @brief Obtain the OpenCV type of a three channel image.
+ * @tparam T
+ *      the channel type
+ */
+template<typename T>
+struct RGBImageType { };
+
+template<>
+struct RGBImageType<uint8_t> : std::integral_constant<int, CV_8UC3> { };
+
+template<>
+struct RGBImageType<uint16_t> : std::integral_constant<int, CV_16UC3> { };
+
+/**
+ * Only 8-bit and 16-bit unsigned images are supported.  Floating-point images
+ * aren't, since the window filters rely on exact integer arithmetic.
+ *
+ * @brief Call a function with the channel type for an image depth.
+ * @param depth
+ *      the image depth, i.e. `img.depth()`
+ * @param func
+ *      generic function called with a default-constructed channel value
+ * @throws std::runtime_error
+ *      if the depth isn't supported
+ */
+template<typename Function>
+void WithDepth(const int depth, Function &&func)
+{
+    switch (depth)
+    {
+        case CV_8U:
+            func(uint8_t());
+            break;
+        case CV_16U:
+            func(uint16_t());
+            break;
+        default:
+            throw std::runtime_error("Input depth not supported by this filter.");
+    }
+}
+
 /**
  * @brief Helper used to define a basic filter operation.
  * @tparam InputType
@@ -63,10 +116,389 @@ struct OperatorBase
     static constexpr int output_type = OutputType;
 };
 
-template<typename Operator, typename ...Args>
-void Filter(cv::Mat &filtered, const cv::Mat &img, Args &&...args)
+/**
+ * An operator can optionally process an entire row segment at once by
+ * providing
+ *
+ *      void ProcessRow(const int y, const int x0, const int x1,
+ *                      const cv::Mat &in, cv::Mat &out);
+ *
+ * which must fill in the pixels `[x0, x1)` of row `y` in `out`.  This avoids
+ * the per-pixel RGBVector round-trip and lets the compiler vectorize the row
+ * loop.  The per-pixel `operator()` is used when it isn't available.
+ *
+ * @brief Check if a filter operator provides a row kernel.
+ */
+template<typename Operator, typename = void>
+struct HasRowKernel : std::false_type { };
+
+template<typename Operator>
+struct HasRowKernel<Operator, std::void_t<decltype(
+    std::declval<Operator &>().ProcessRow(0, 0, 0,
+                                          std::declval<const cv::Mat &>(),
+                                          std::declval<cv::Mat &>())
+)>> : std::true_type { };
+
+/**
+ * An operator that reads a fixed neighbourhood around each pixel can declare
+ *
+ *      static constexpr int border = N;
+ *
+ * to have the driver pad the input by `N` pixels, replicating the image edges,
+ * before it is filtered.  The operator receives a view onto the padded input
+ * where the row pointers can be safely offset by up to `N` rows or columns.
+ * Replicating the edges is identical to clamping the coordinates, so the
+ * operator can skip the clamping altogether.
+ *
+ * @brief Obtain the size of the border an operator requires.
+ */
+template<typename Operator, typename = void>
+struct BorderSize : std::integral_constant<int, 0> { };
+
+template<typename Operator>
+struct BorderSize<Operator, std::void_t<decltype(Operator::border)>>
+    : std::integral_constant<int, Operator::border> { };
+
+/**
+ * An operator that reads a neighbourhood whose size is only known at run time,
+ * e.g. a filter window, can report it by providing
+ *
+ *      int Halo() const;
+ *
+ * The operator is expected to clamp its reads to the image bounds rather than
+ * relying on a padded border.  Such an operator must also provide
+ *
+ *      void Reset();
+ *
+ * which discards any state (e.g. a sliding window) carried over from earlier
+ * pixels.  It's called whenever the contents of the operator's input change.
+ *
+ * @brief Check if a filter operator reports its halo.
+ */
+template<typename Operator, typename = void>
+struct HasHalo : std::false_type { };
+
+template<typename Operator>
+struct HasHalo<Operator, std::void_t<decltype(
+    std::declval<const Operator &>().Halo()
+)>> : std::true_type { };
+
+/**
+ * @brief Obtain the number of pixels an operator reads on either side of a
+ *      pixel.
+ */
+template<typename Operator>
+int OperatorHalo(const Operator &op)
+{
+    if constexpr (HasHalo<Operator>::value)
+        return op.Halo();
+    else
+        return BorderSize<Operator>::value;
+}
+
+/**
+ * @brief Strategies used to hand the tiles out to the worker threads.
+ */
+enum class Partitioner
+{
+    kAuto,      ///< split adaptively, based on the load (tbb::auto_partitioner)
+    kSimple,    ///< one task per tile (tbb::simple_partitioner)
+    kStatic     ///< split evenly across the workers (tbb::static_partitioner)
+};
+
+/**
+ * Tiles are the units of work for FilterTiles().  A zero size means that the
+ * size is chosen automatically (see AutoTileLayout()).
+ *
+ * @brief Controls how the tiled filter driver splits an image.
+ */
+struct TileLayout
+{
+    int rows = 0;   ///< number of rows in a tile
+    int cols = 0;   ///< number of columns in a tile
+    Partitioner partitioner = Partitioner::kAuto;   ///< partitioning strategy
+};
+
+/**
+ * @brief The size of the per-core (L2) cache, in bytes.
+ * @note Falls back onto a conservative default if it can't be queried.
+ */
+int CacheSize();
+
+/**
+ * The tiles are sized so that a tile's input, including the halo, and its
+ * output fit in about half of the L2 cache, leaving the rest for the
+ * operator's own state.  Tiles are as square as possible, to keep the halo
+ * overhead down, with a width that is a multiple of 16 pixels.  They are made
+ * shorter if there wouldn't be enough of them to keep every worker busy.
+ *
+ * @brief Choose a tile layout based on the cache size.
+ * @param size
+ *      the image size
+ * @param halo
+ *      the number of pixels an operator reads on either side of a pixel
+ * @param pixel_bytes
+ *      the number of bytes in an input pixel plus an output pixel
+ */
+TileLayout AutoTileLayout(const cv::Size &size, const int halo,
+                          const int pixel_bytes);
+
+/**
+ * @brief Copy a region of an image, replicating the edge pixels for any part
+ *      of the region that falls outside of the image.
+ * @param img
+ *      the source image
+ * @param region
+ *      the region being copied
+ * @param dst
+ *      the destination; must be at least as large as the region
+ */
+inline void CopyRegion(const cv::Mat &img, const cv::Rect &region,
+                       cv::Mat &dst)
+{
+    const size_t pixel = img.elemSize();
+    const int x0 = std::clamp(region.x, 0, img.cols);
+    const int x1 = std::clamp(region.x + region.width, 0, img.cols);
+
+    for (int r = 0; r < region.height; r++)
+    {
+        const int y = std::clamp(region.y + r, 0, img.rows - 1);
+        const uint8_t *src = img.ptr<uint8_t>(y);
+        uint8_t *out = dst.ptr<uint8_t>(r);
+
+        for (int x = region.x; x < x0; x++, out += pixel)
+            std::memcpy(out, src, pixel);
+
+        std::memcpy(out, src + x0*pixel, (x1 - x0)*pixel);
+        out += (x1 - x0)*pixel;
+
+        for (int x = x1; x < region.x + region.width; x++, out += pixel)
+            std::memcpy(out, src + (img.cols - 1)*pixel, pixel);
+    }
+}
+
+/**
+ * @brief Apply an operator onto a block of pixels.
+ * @param op
+ *      the operator object
+ * @param input
+ *      the operator input
+ * @param filtered
+ *      the operator output; uses the same coordinates as the input
+ * @param block
+ *      the pixels being processed
+ */
+template<typename Operator>
+void ProcessBlock(Operator &op, const cv::Mat &input, cv::Mat &filtered,
+                  const cv::Rect &block)
 {
     typedef typename OpenCVTypeInfo<Operator::output_type>::type out_type;
+    const int channels = OpenCVTypeInfo<Operator::output_type>::channels;
+
+    const int x_start = block.x;
+    const int x_end = block.x + block.width;
+
+    const int y_start = block.y;
+    const int y_end = block.y + block.height;
+
+    // Use the operator's row kernel if it has one, otherwise fall back onto
+    // the per-pixel operator.
+    if constexpr (HasRowKernel<Operator>::value)
+    {
+        for (int y = y_start; y != y_end; y++)
+            op.ProcessRow(y, x_start, x_end, input, filtered);
+    }
+    else
+    {
+        for (int y = y_start; y != y_end; y++)
+        {
+            auto row = filtered.ptr<out_type>(y);
+            for (int x = x_start; x != x_end; x++)
+            {
+                const int i = channels*x;
+
+                // Perform the filtering operation.
+                RGBVector output = op(x, y, input);
+
+                // Insert pixel values based on the number of channels by
+                // exploiting how a switch-case statement works.
+                switch(channels)
+                {
+                    case 4:
+                    case 3:
+                        row[i+2] = output.blue;
+                    case 2:
+                        row[i+1] = output.green;
+                    case 1:
+                        row[i] = output.red;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Run a parallel loop over an image range with the given partitioner.
+ * @param range
+ *      the range being processed
+ * @param partitioner
+ *      partitioning strategy
+ * @param body
+ *      the loop body
+ */
+template<typename Range, typename Body>
+void ParallelFor(const Range &range, const Partitioner partitioner,
+                 const Body &body)
+{
+    switch (partitioner)
+    {
+        case Partitioner::kSimple:
+            tbb::parallel_for(range, body, tbb::simple_partitioner());
+            break;
+        case Partitioner::kStatic:
+            tbb::parallel_for(range, body, tbb::static_partitioner());
+            break;
+        case Partitioner::kAuto:
+        default:
+            tbb::parallel_for(range, body, tbb::auto_partitioner());
+            break;
+    }
+}
+
+/**
+ * FilterTiles() gives each worker thread its own copy of the operator.  The
+ * copies are kept between calls, indexed by the thread's slot in the current
+ * task arena, so any storage they allocate (e.g. their sliding windows) is
+ * reused.  They're only reconstructed if the operator type or the arguments it
+ * was constructed with change.  A cache must only be used by one call at a
+ * time.
+ *
+ * @brief Per-thread operators used by the tiled filter driver.
+ */
+typedef std::vector<std::any> OperatorCache;
+
+/**
+ * @brief An operator in an OperatorCache, along with the arguments that it was
+ *      constructed with.
+ */
+template<typename Operator, typename ...Args>
+struct CachedOperator
+{
+    std::tuple<Args...> args;   ///< the constructor arguments
+    Operator initial;           ///< the operator, as it was constructed
+    Operator op;                ///< the operator used for filtering
+};
+
+/**
+ * FilterTiles() copies each tile into a buffer owned by the worker thread
+ * processing it.  The buffers are indexed by the thread's slot in the current
+ * task arena and only grow, so a set of buffers that is reused between calls
+ * is only allocated once.  A set of buffers must only be used by one call at a
+ * time.
+ *
+ * @brief Per-thread tile buffers used by the tiled filter driver.
+ */
+typedef std::vector<cv::Mat> TileBuffers;
+
+/**
+ * @brief Make sure that every worker thread has an operator in the cache.
+ * @tparam Operator
+ *      the operator object that will perform the filtering
+ * @param operators
+ *      the per-thread operators; reused if they were constructed with the
+ *      same arguments
+ * @param args
+ *      any arguments that will be passed into the filtering operator
+ * @return
+ *      the number of worker threads
+ */
+template<typename Operator, typename ...Args>
+size_t PrepareOperators(OperatorCache &operators, Args &&...args)
+{
+    typedef CachedOperator<Operator, std::decay_t<Args>...> cached_type;
+
+    // Every worker thread gets its own copy of the same operator.  Copies left
+    // over from an earlier call are reused if they're the same operator with
+    // the same arguments.
+    const size_t num_workers = tbb::this_task_arena::max_concurrency();
+    if (operators.size() < num_workers)
+        operators.resize(num_workers);
+
+    const std::tuple<std::decay_t<Args>...> key(args...);
+    for (size_t i = 0; i < operators.size(); i++)
+    {
+        cached_type *cached = std::any_cast<cached_type>(&operators[i]);
+        if (cached == nullptr || !(cached->args == key))
+        {
+            if (i == 0)
+            {
+                Operator op(args...);
+                operators[0] = cached_type{key, op, op};
+            }
+            else
+            {
+                operators[i] = *std::any_cast<cached_type>(&operators[0]);
+            }
+            continue;
+        }
+
+        // A reused operator mustn't carry any state (e.g. a sliding window's
+        // position) over from the last image.  Assigning the operator reuses
+        // its storage rather than reallocating it.
+        cached->op = cached->initial;
+    }
+
+    return num_workers;
+}
+
+/**
+ * The driver gives each task a tile and copies the tile, plus the halo the
+ * operator needs around it, into a small buffer owned by the worker thread.
+ * The buffer is sized to stay in the cache, so the operator never has to reach
+ * out into the rest of the image, and the tiles' rows don't share any cache
+ * lines or pages with the tiles being processed by the other workers.
+ *
+ * The halo is handled according to what the operator declares:
+ *
+ *  - an operator with a `border` gets a view onto the tile with the border
+ *    around it, where the image edges are replicated;
+ *  - an operator with a `Halo()` gets the tile plus its halo, clipped to the
+ *    image, so that any clamping at the image edges behaves as before;
+ *  - any other operator reads its pixels directly out of the image.
+ *
+ * Each worker thread gets its own copy of the operator and reuses it for every
+ * tile it processes, and for later calls with the same operator (see
+ * OperatorCache).  The operators must be copy-constructible and must not
+ * assume that the tiles are visited in any particular order.  The arguments
+ * must be copyable and comparable with `==`.  The input and output must not be
+ * the same image, unless the operator has neither a border nor a halo.
+ *
+ * @brief Apply a filter onto an image using cache-sized tiles.
+ * @tparam Operator
+ *      the operator object that will perform the filtering
+ * @param filtered
+ *      the output image; must already have the operator's output type
+ * @param img
+ *      the image being filtered
+ * @param layout
+ *      how the image is split into tiles
+ * @param buffers
+ *      the per-thread tile buffers; grown as needed
+ * @param operators
+ *      the per-thread operators; reused if they were constructed with the
+ *      same arguments
+ * @param args
+ *      any arguments that will be passed into the filtering operator
+ * @throws std::runtime_error
+ *      if the input or output don't have the operator's types
+ */
+template<typename Operator, typename ...Args>
+void FilterTiles(cv::Mat &filtered, const cv::Mat &img,
+                 const TileLayout &layout, TileBuffers &buffers,
+                 OperatorCache &operators, Args &&...args)
+{
+    typedef CachedOperator<Operator, std::decay_t<Args>...> cached_type;
+    constexpr int border = BorderSize<Operator>::value;
 
     if (img.type() != Operator::input_type)
         throw std::runtime_error("Input type not supported by this filter.");
@@ -74,54 +506,138 @@ void Filter(cv::Mat &filtered, const cv::Mat &img, Args &&...args)
     if (filtered.type() != Operator::output_type)
         throw std::runtime_error("Output type not supported by this filter.");
 
-    const int channels = OpenCVTypeInfo<Operator::output_type>::channels;
+    if (img.empty())
+        return;
 
-    // Apply the filter across all pixels in the image.  The model assumes that
-    // each (x,y) position will produce a single RGB value that is then stored
-    // in the output image.
-    const tbb::blocked_range2d<int> range(0, img.rows, 0, img.cols);
-    tbb::parallel_for<tbb::blocked_range2d<int>>(
-        range,
-        [&](const tbb::blocked_range2d<int> &block)
-        {
-            // Construct the filtering operator (in case it allocates some of
-            // its own memory for internal buffers).
-            Operator op(std::forward<Args>(args)...);
+    const size_t num_workers = PrepareOperators<Operator>(operators, args...);
+    const int halo = OperatorHalo(std::any_cast<cached_type>(&operators[0])->op);
+    const bool copy = border > 0 || halo > 0;
 
-            const int x_start = block.cols().begin();
-            const int x_end = block.cols().end();
+    TileLayout tiles = layout;
+    if (tiles.rows < 1 || tiles.cols < 1)
+    {
+        const TileLayout automatic = AutoTileLayout(
+            img.size(), halo, img.elemSize() + filtered.elemSize()
+        );
+        tiles.rows = tiles.rows < 1 ? automatic.rows : tiles.rows;
+        tiles.cols = tiles.cols < 1 ? automatic.cols : tiles.cols;
+    }
 
-            const int y_start = block.rows().begin();
-            const int y_end = block.rows().end();
+    // Each worker thread gets its own tile buffer.  They're only reallocated
+    // if they're too small for the tiles.
+    if (copy && buffers.size() < num_workers)
+        buffers.resize(num_workers);
 
-            for (int y = y_start; y != y_end; y++)
+    const int buffer_rows = tiles.rows + 2*halo;
+    const int buffer_cols = tiles.cols + 2*halo;
+
+    const int num_rows = (img.rows + tiles.rows - 1) / tiles.rows;
+    const int num_cols = (img.cols + tiles.cols - 1) / tiles.cols;
+    const cv::Rect bounds(0, 0, img.cols, img.rows);
+
+    ParallelFor(
+        tbb::blocked_range2d<int>(0, num_rows, 0, num_cols),
+        tiles.partitioner,
+        [&](const tbb::blocked_range2d<int> &block)
+        {
+            // The operator and the tile buffer belong to this thread's slot,
+            // so the thread mustn't pick up another block while it's using
+            // them.
+            tbb::this_task_arena::isolate([&]
             {
-                auto row = filtered.ptr<out_type>(y);
-                for (int x = x_start; x != x_end; x++)
-                {
-                    const int i = channels*x;
+                const int slot = tbb::this_task_arena::current_thread_index();
+                Operator &op = std::any_cast<cached_type>(&operators[slot])->op;
 
-                    // Perform the filtering operation.
-                    RGBVector output = op(x, y, img);
+                const tbb::blocked_range<int> &rows = block.rows();
+                const tbb::blocked_range<int> &cols = block.cols();
 
-                    // Insert pixel values based on the number of channels by
-                    // exploiting how a switch-case statement works.
-                    switch(channels)
+                for (int ty = rows.begin(); ty != rows.end(); ty++)
+                    for (int tx = cols.begin(); tx != cols.end(); tx++)
                     {
-                        case 4:
-                        case 3:
-                            row[i+2] = output.blue;
-                        case 2:
-                            row[i+1] = output.green;
-                        case 1:
-                            row[i] = output.red;
+                        const cv::Rect tile = cv::Rect(tx*tiles.cols,
+                                                       ty*tiles.rows,
+                                                       tiles.cols, tiles.rows)
+                                              & bounds;
+
+                        if (!copy)
+                        {
+                            ProcessBlock(op, img, filtered, tile);
+                            continue;
+                        }
+
+                        // The region of the image that the operator will see.
+                        // Operators with a border see the tile, with the
+                        // border around it, while the others see the tile and
+                        // as much of the halo as lies within the image.
+                        cv::Rect source;
+                        cv::Rect region;
+                        if constexpr (border > 0)
+                        {
+                            source = cv::Rect(tile.x - border, tile.y - border,
+                                              tile.width + 2*border,
+                                              tile.height + 2*border);
+                            region = tile;
+                        }
+                        else
+                        {
+                            source = cv::Rect(tile.x - halo, tile.y - halo,
+                                              tile.width + 2*halo,
+                                              tile.height + 2*halo) & bounds;
+                            region = source;
+                        }
+
+                        cv::Mat &buffer = buffers[slot];
+                        if (buffer.type() != img.type() ||
+                            buffer.rows < buffer_rows ||
+                            buffer.cols < buffer_cols)
+                        {
+                            buffer.create(buffer_rows, buffer_cols, img.type());
+                        }
+
+                        CopyRegion(img, source, buffer);
+
+                        if constexpr (HasHalo<Operator>::value)
+                            op.Reset();
+
+                        const cv::Mat input = buffer(cv::Rect(
+                            region.x - source.x, region.y - source.y,
+                            region.width, region.height
+                        ));
+                        cv::Mat output = filtered(region);
+                        ProcessBlock(op, input, output,
+                                     cv::Rect(tile.x - region.x,
+                                              tile.y - region.y,
+                                              tile.width, tile.height));
                     }
-                }
-            }
+            });
         }
     );
 }
 
+/**
+ * @brief Apply a filter onto an image, writing into an existing image.
+ * @tparam Operator
+ *      the operator object that will perform the filtering
+ * @param filtered
+ *      the output image; must already have the operator's output type
+ * @param img
+ *      the image being filtered
+ * @param args
+ *      any arguments that will be passed into the filtering operator
+ * @throws std::runtime_error
+ *      if the input or output don't have the operator's types
+ */
+template<typename Operator, typename ...Args>
+void Filter(cv::Mat &filtered, const cv::Mat &img, Args &&...args)
+{
+    // The input is read directly if the operator doesn't need a border or a
+    // halo, which matters for operators that run in-place.
+    TileBuffers buffers;
+    OperatorCache operators;
+    FilterTiles<Operator>(filtered, img, TileLayout(), buffers, operators,
+                          std::forward<Args>(args)...);
+}
+
 /**
  * @brief Apply a filter onto an image.
  * @tparam Operator
@@ -133,7 +649,7 @@ void Filter(cv::Mat &filtered, const cv::Mat &img, Args &&...args)
  * @return
  *      the filtered image
  * @throws std::runtime_error
- *      if the input image doesn't have 8-bit depth
+ *      if the input image doesn't have the operator's input type
  */
 template<typename Operator, typename ...Args>
 cv::Mat Filter(const cv::Mat &img, Args &&...args)
@@ -0,0 +1,418 @@
+/**
+ * @file
+ * @brief A sliding window that keeps the aggregate distances of its pixels up
+ *      to date for distances without a closed form.
+ */
+#ifndef SRC_CHROMAVEC_UTILITIES_PAIRWISE_WINDOW_H_
+#define SRC_CHROMAVEC_UTILITIES_PAIRWISE_WINDOW_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include "distances.h"
+#include "rgbvector.h"
+#include "sliding-window.h"
+
+namespace chromavec { namespace internal {
+
+/**
+ * The closed form used by SlidingAggregateDistances only exists for the
+ * squared Euclidean distance.  Any other distance needs the distance between
+ * every pair of pixels in the window.  Because d(i,j) = d(j,i) and d(i,i) = 0,
+ * each unordered pair is only evaluated once and stored in a triangular
+ * buffer, and its value is added onto the aggregates of both pixels.
+ *
+ * The buffer is indexed by window slot, just like SlidingAggregateDistances,
+ * so moving one pixel to the right only has to evaluate the pairs involving
+ * the incoming column.  The pairs involving the outgoing column are read back
+ * out of the buffer and subtracted.  A window with N pixels and width W then
+ * costs O(N*W) distance evaluations per pixel rather than O(N^2).
+ *
+ * The pair of slots i < j is stored at j*(j-1)/2 + i, so a window with N
+ * slots needs N*(N-1)/2 entries.  A slot's pairs with the slots below it are
+ * contiguous, while its pairs with the slots above it are strided.  Columns
+ * occupy consecutive slots, so pairing a pixel with a column only ever touches
+ * one of the two.  The distances are computed over WindowPlanes, one column at
+ * a time, so the loops run over contiguous arrays and the common, contiguous
+ * case is vectorized by the compiler.
+ *
+ * The aggregates are integer sums, so they are identical to the ones from a
+ * direct evaluation over the window regardless of the order of the pairs.
+ * Like SlidingAggregateDistances, the distances and sums use the colour's
+ * magnitude type so that they don't overflow for 16-bit images.
+ *
+ * @brief Incrementally maintain the pairwise distances for a sliding window.
+ * @tparam Distance
+ *      the distance policy (see distances.h)
+ * @tparam FixedWidth
+ *      the window width, or kDynamicWidth if it is only known at run time
+ * @tparam T
+ *      the image's channel type
+ */
+template<typename Distance, int FixedWidth = kDynamicWidth,
+         typename T = uint8_t>
+class SlidingPairwiseDistances
+{
+public:
+    typedef typename MagType<T>::type aggregate_type;
+
+    /**
+     * @brief Construct a new sliding window.
+     * @param width
+     *      width and height of the window
+     * @throws std::runtime_error
+     *      if the width doesn't match the compile-time width or the pair
+     *      buffer for the width can't be addressed
+     */
+    SlidingPairwiseDistances(const int width)
+        : width_(width),
+          x_(-1),
+          y_(-1),
+          x_start_(0),
+          x_end_(-1),
+          y_start_(0),
+          height_(0)
+    {
+        if (width < 1)
+            throw std::runtime_error("Window width must be positive.");
+        if (FixedWidth != kDynamicWidth && width != FixedWidth)
+            throw std::runtime_error("Window width doesn't match the fixed width.");
+
+        // Slots are indexed with an 'int', so the window's area has to fit in
+        // one.  The number of pairs is then computed as a product of two
+        // factors that can be checked for overflow individually.
+        if (width > std::numeric_limits<int>::max()/width)
+            throw std::runtime_error("Window width is too large.");
+
+        const size_t area = static_cast<size_t>(width)*width;
+        const size_t a = area % 2 == 0 ? area/2 : area;
+        const size_t b = area % 2 == 0 ? area - 1 : (area - 1)/2;
+        if (b != 0 && a > this->pairs_.max_size()/b)
+            throw std::runtime_error("Window width is too large.");
+
+        this->pairs_.resize(a*b);
+        this->colours_.Allocate(width);
+        AllocateWindow(this->sums_, width);
+    }
+
+    /**
+     * @brief The width of the window (ignores clamping).
+     */
+    int Width() const
+    {
+        if constexpr (FixedWidth != kDynamicWidth)
+            return FixedWidth;
+        else
+            return this->width_;
+    }
+
+    /**
+     * @brief Move the window so that it is centred on the given pixel.
+     * @param img
+     *      image being processed
+     * @param x, y
+     *      the centre of the window
+     */
+    void MoveTo(const cv::Mat &img, const int x, const int y)
+    {
+        const int half = this->Width()/2;
+        const int x_start = std::clamp(x - half, 0, img.cols-1);
+        const int x_end = std::clamp(x + half, 0, img.cols-1);
+
+        if (y == this->y_ && x == this->x_ + 1)
+        {
+            while (this->x_start_ < x_start)
+                this->RemoveColumn(this->x_start_);
+
+            while (this->x_end_ < x_end)
+                this->AddColumn(img, this->x_end_ + 1);
+        }
+        else
+        {
+            const int y_start = std::clamp(y - half, 0, img.rows-1);
+            const int y_end = std::clamp(y + half, 0, img.rows-1);
+
+            this->y_start_ = y_start;
+            this->height_ = y_end - y_start + 1;
+            this->x_start_ = x_start;
+            this->x_end_ = x_start - 1;
+
+            for (int xi = x_start; xi <= x_end; xi++)
+                this->AddColumn(img, xi);
+        }
+
+        this->x_ = x;
+        this->y_ = y;
+    }
+
+    /**
+     * @brief Forget the window's position so that the next move rebuilds it.
+     * @note Must be called if the contents of the image being processed
+     *      change between moves.
+     */
+    void Invalidate()
+    {
+        this->x_ = -1;
+        this->y_ = -1;
+    }
+
+    /**
+     * @brief Index of the first column in the window (in image coordinates).
+     */
+    int XStart() const { return this->x_start_; }
+
+    /**
+     * @brief Index of the last column in the window (in image coordinates).
+     */
+    int XEnd() const { return this->x_end_; }
+
+    /**
+     * @brief The height of the window (includes clamping).
+     */
+    int Height() const { return this->height_; }
+
+    /**
+     * @brief Obtain the colour of a pixel in the window.
+     * @param x
+     *      pixel column, in image coordinates
+     * @param yi
+     *      row within the window
+     */
+    RGBVector<T> Colour(const int x, const int yi) const
+    {
+        return this->colours_.Colour(this->Slot(x, yi));
+    }
+
+    /**
+     * @brief Obtain the aggregate distance of a pixel in the window.
+     * @param x
+     *      pixel column, in image coordinates
+     * @param yi
+     *      row within the window
+     */
+    aggregate_type Aggregate(const int x, const int yi) const
+    {
+        return this->sums_[this->Slot(x, yi)];
+    }
+
+    /**
+     * @brief The number of pixels in the window (includes clamping).
+     */
+    int Count() const
+    {
+        return (this->x_end_ - this->x_start_ + 1)*this->height_;
+    }
+
+    /**
+     * @brief Visit all of the pixels in the window in row-major order.
+     * @param visit
+     *      function called as `visit(aggregate, colour)` for each pixel
+     */
+    template<typename Visitor>
+    void ForEach(Visitor &&visit) const
+    {
+        for (int yi = 0; yi < this->height_; yi++)
+            for (int xi = this->x_start_; xi <= this->x_end_; xi++)
+            {
+                const int slot = this->Slot(xi, yi);
+                visit(this->sums_[slot], this->colours_.Colour(slot));
+            }
+    }
+
+private:
+    int Slot(const int x, const int yi) const
+    {
+        return (x % this->Width())*this->Width() + yi;
+    }
+
+    /**
+     * @brief Index of the pair of slots 'lo' and 'hi' in the pair buffer.
+     * @note Requires lo < hi.
+     */
+    static size_t PairIndex(const int lo, const int hi)
+    {
+        return static_cast<size_t>(hi)*(hi - 1)/2 + lo;
+    }
+
+    /**
+     * @brief Visit the pair buffer entries between a slot and a run of
+     *      consecutive slots.
+     * @param slot
+     *      the pixel's slot
+     * @param base
+     *      first slot in the run, which must not contain 'slot'
+     * @param count
+     *      number of slots in the run
+     * @param visit
+     *      function called as `visit(i, pair)` for the i-th slot in the run
+     */
+    template<typename Visitor>
+    void ForEachPair(const int slot, const int base, const int count,
+                     Visitor &&visit)
+    {
+        if (count == 0)
+            return;
+
+        if (base < slot)
+        {
+            // The run is below the slot, so its pairs are contiguous.
+            aggregate_type *pairs = &this->pairs_[PairIndex(base, slot)];
+            for (int i = 0; i < count; i++)
+                visit(i, pairs[i]);
+        }
+        else
+        {
+            // The run is above the slot, so the pair with slot j is j entries
+            // after the pair with slot j - 1.
+            size_t index = PairIndex(slot, base);
+            for (int i = 0; i < count; i++)
+            {
+                visit(i, this->pairs_[index]);
+                index += base + i;
+            }
+        }
+    }
+
+    /**
+     * @brief Pair a pixel with a run of consecutive slots.
+     * @param slot
+     *      the pixel's slot
+     * @param base
+     *      first slot in the run, which must not contain 'slot'
+     * @param count
+     *      number of slots in the run
+     * @return
+     *      the sum of the distances between the pixel and the run
+     */
+    aggregate_type PairWith(const int slot, const int base, const int count)
+    {
+        typedef typename WindowPlanes<FixedWidth, T>::plane_type plane_type;
+
+        const aggregate_type r = this->colours_.red[slot];
+        const aggregate_type g = this->colours_.green[slot];
+        const aggregate_type b = this->colours_.blue[slot];
+
+        const plane_type *red = &this->colours_.red[base];
+        const plane_type *green = &this->colours_.green[base];
+        const plane_type *blue = &this->colours_.blue[base];
+
+        aggregate_type *sums = &this->sums_[base];
+
+        aggregate_type total = 0;
+        this->ForEachPair(slot, base, count,
+                          [&](const int i, aggregate_type &pair)
+        {
+            const aggregate_type d = Distance::FromDifferences(
+                red[i] - r, green[i] - g, blue[i] - b
+            );
+            pair = d;
+            sums[i] += d;
+            total += d;
+        });
+
+        return total;
+    }
+
+    void AddColumn(const cv::Mat &img, const int x)
+    {
+        const int base = this->Slot(x, 0);
+        this->colours_.Load(img, x, this->y_start_, this->height_, base);
+
+        // When the window isn't clamped, every slot outside of the incoming
+        // column is in use, so the other columns form (at most) two runs.
+        const int area = this->Width()*this->Width();
+        const bool full = this->height_ == this->Width() &&
+                          this->x_end_ - this->x_start_ + 2 == this->Width();
+
+        for (int k = 0; k < this->height_; k++)
+        {
+            // Pair the new pixel with everything already in the window,
+            // including the pixels above it in the incoming column.
+            aggregate_type sum = 0;
+            if (full)
+            {
+                const int end = base + this->height_;
+                sum += this->PairWith(base + k, 0, base);
+                sum += this->PairWith(base + k, end, area - end);
+            }
+            else
+            {
+                for (int xi = this->x_start_; xi <= this->x_end_; xi++)
+                    sum += this->PairWith(base + k, this->Slot(xi, 0),
+                                          this->height_);
+            }
+
+            sum += this->PairWith(base + k, base, k);
+            this->sums_[base + k] = sum;
+        }
+
+        this->x_end_ = x;
+    }
+
+    void RemoveColumn(const int x)
+    {
+        const int base = this->Slot(x, 0);
+
+        // Only the pixels that stay in the window need to be updated.  They
+        // were all added after the outgoing column, so the buffer holds their
+        // distances to it.
+        for (int xi = x + 1; xi <= this->x_end_; xi++)
+        {
+            const int other = this->Slot(xi, 0);
+            for (int yi = 0; yi < this->height_; yi++)
+            {
+                aggregate_type sum = 0;
+                this->ForEachPair(other + yi, base, this->height_,
+                                  [&sum](const int, const aggregate_type &pair)
+                {
+                    sum += pair;
+                });
+
+                this->sums_[other + yi] -= sum;
+            }
+        }
+
+        this->x_start_ = x + 1;
+    }
+
+    int width_;
+    int x_, y_;
+    int x_start_, x_end_;
+    int y_start_, height_;
+
+    WindowPlanes<FixedWidth, T> colours_;
+    WindowBuffer<aggregate_type, FixedWidth> sums_;
+    std::vector<aggregate_type,
+                tbb::cache_aligned_allocator<aggregate_type>> pairs_;
+};
+
+/**
+ * @brief Select the sliding window used to compute the aggregates for a
+ *      distance policy.
+ * @tparam Distance
+ *      the distance policy (see distances.h)
+ * @tparam FixedWidth
+ *      the window width, or kDynamicWidth if it is only known at run time
+ * @tparam T
+ *      the image's channel type
+ */
+template<typename Distance, int FixedWidth = kDynamicWidth,
+         typename T = uint8_t>
+using AggregateWindow = std::conditional_t<
+    Distance::closed_form,
+    SlidingAggregateDistances<FixedWidth, T>,
+    SlidingPairwiseDistances<Distance, FixedWidth, T>
+>;
+
+}} // namespace chromavec::internal
+
+#endif // SRC_CHROMAVEC_UTILITIES_PAIRWISE_WINDOW_H_
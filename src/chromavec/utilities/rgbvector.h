@@ -1,8 +1,10 @@
 #ifndef SRC_CHROMAVEC_VECTOR_H_
 #define SRC_CHROMAVEC_VECTOR_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <cmath>
+#include <cstdlib>
 #include <type_traits>
 
 #include <opencv2/core.hpp>
@@ -27,6 +29,12 @@ struct DiffType<uint8_t> { typedef int16_t type; };
 template<>
 struct DiffType<int16_t> { typedef int type; };
 
+/**
+ * @brief Promote a uint16_t difference to int32_t.
+ */
+template<>
+struct DiffType<uint16_t> { typedef int32_t type; };
+
 /**
  * Any integer type is automatically promoted to an integer.  Floating-point
  * types remain as the same type.
@@ -39,6 +47,15 @@ struct MagType
     typedef std::conditional_t<std::is_integral<T>::value, int, T> type;
 };
 
+/**
+ * The squared distance between two 16-bit colours can be as large as
+ * 3*65535^2, which doesn't fit into an int.
+ *
+ * @brief Promote a uint16_t magnitude to int64_t.
+ */
+template<>
+struct MagType<uint16_t> { typedef int64_t type; };
+
 /**
  * @brief Define an RGB vector
  */
@@ -147,7 +164,44 @@ struct RGBVector
      */
     mag_type SquaredDistance(const RGBVector<T> &other) const
     {
-        return (*this - other).SquaredMagnitude();
+        // The difference's own magnitude type may be too narrow, so the
+        // squares are computed with this vector's magnitude type.
+        const RGBVector<diff_type> d = *this - other;
+        const mag_type r = static_cast<mag_type>(d.red);
+        const mag_type g = static_cast<mag_type>(d.green);
+        const mag_type b = static_cast<mag_type>(d.blue);
+
+        return r*r + g*g + b*b;
+    }
+
+    /**
+     * @brief Compute the sum of the absolute channel differences (L1).
+     * @param other
+     *      the other vector
+     * @return
+     *      the L1-norm of `this - other`
+     */
+    mag_type AbsoluteDistance(const RGBVector<T> &other) const
+    {
+        const RGBVector<diff_type> d = *this - other;
+        return std::abs(static_cast<mag_type>(d.red)) +
+               std::abs(static_cast<mag_type>(d.green)) +
+               std::abs(static_cast<mag_type>(d.blue));
+    }
+
+    /**
+     * @brief Compute the largest absolute channel difference (L-infinity).
+     * @param other
+     *      the other vector
+     * @return
+     *      the L-infinity norm of `this - other`
+     */
+    mag_type MaximumDistance(const RGBVector<T> &other) const
+    {
+        const RGBVector<diff_type> d = *this - other;
+        return std::max({std::abs(static_cast<mag_type>(d.red)),
+                         std::abs(static_cast<mag_type>(d.green)),
+                         std::abs(static_cast<mag_type>(d.blue))});
     }
 };
 
@@ -0,0 +1,207 @@
+#include "sliding-window.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#include "constants.h"
+
+namespace chromavec { namespace internal {
+
+template<int FixedWidth, typename T>
+SlidingAggregateDistances<FixedWidth, T>::SlidingAggregateDistances(const int width)
+    : width_(width),
+      x_(-1),
+      y_(-1),
+      x_start_(0),
+      x_end_(-1),
+      y_start_(0),
+      height_(0),
+      sum_r_(0),
+      sum_g_(0),
+      sum_b_(0),
+      sum_sq_(0)
+{
+    if (width < 1)
+        throw std::runtime_error("Window width must be positive.");
+    if (FixedWidth != kDynamicWidth && width != FixedWidth)
+        throw std::runtime_error("Window width doesn't match the fixed width.");
+
+    // An aggregate is a sum of up to width^2 squared distances, so it has to
+    // fit the largest of those sums.  The closed form is evaluated in 64 bits,
+    // where its terms add up to at most twice that.
+    const int64_t max_count = std::numeric_limits<int64_t>::max()
+                              / (2*kMaxColourDistanceSq<T>);
+    const int64_t max_aggregate = std::numeric_limits<aggregate_type>::max();
+    const int64_t count = static_cast<int64_t>(width)*width;
+    if (count > max_count ||
+        count > max_aggregate / kMaxColourDistanceSq<T>)
+    {
+        throw std::runtime_error("Window width is too large.");
+    }
+
+    this->colours_.Allocate(width);
+    AllocateWindow(this->aggregates_, width);
+}
+
+template<int FixedWidth, typename T>
+void SlidingAggregateDistances<FixedWidth, T>::MoveTo(const cv::Mat &img,
+                                                      const int x, const int y)
+{
+    const int half = this->Width()/2;
+    const int x_start = std::clamp(x - half, 0, img.cols-1);
+    const int x_end = std::clamp(x + half, 0, img.cols-1);
+
+    if (y == this->y_ && x == this->x_ + 1)
+    {
+        // The window moved one pixel to the right, so drop anything that fell
+        // off of the left side and then add in anything new on the right.
+        while (this->x_start_ < x_start)
+            this->RemoveColumn(this->x_start_);
+
+        while (this->x_end_ < x_end)
+            this->AddColumn(img, this->x_end_ + 1);
+    }
+    else
+    {
+        // Any other move invalidates the window, so rebuild it one column at
+        // a time.
+        const int y_start = std::clamp(y - half, 0, img.rows-1);
+        const int y_end = std::clamp(y + half, 0, img.rows-1);
+
+        this->Reset();
+        this->y_start_ = y_start;
+        this->height_ = y_end - y_start + 1;
+        this->x_start_ = x_start;
+        this->x_end_ = x_start - 1;
+
+        for (int xi = x_start; xi <= x_end; xi++)
+            this->AddColumn(img, xi);
+    }
+
+    this->x_ = x;
+    this->y_ = y;
+
+    this->UpdateAggregates();
+}
+
+template<int FixedWidth, typename T>
+void SlidingAggregateDistances<FixedWidth, T>::AddColumn(const cv::Mat &img,
+                                                         const int x)
+{
+    const int base = this->Slot(x, 0);
+    this->colours_.Load(img, x, this->y_start_, this->height_, base);
+    this->AccumulateColumn(base, 1);
+    this->x_end_ = x;
+}
+
+template<int FixedWidth, typename T>
+void SlidingAggregateDistances<FixedWidth, T>::RemoveColumn(const int x)
+{
+    this->AccumulateColumn(this->Slot(x, 0), -1);
+    this->x_start_ = x + 1;
+}
+
+template<int FixedWidth, typename T>
+void SlidingAggregateDistances<FixedWidth, T>::Reset()
+{
+    this->sum_r_ = 0;
+    this->sum_g_ = 0;
+    this->sum_b_ = 0;
+    this->sum_sq_ = 0;
+}
+
+template<int FixedWidth, typename T>
+void SlidingAggregateDistances<FixedWidth, T>::AccumulateColumn(const int base,
+                                                                const int sign)
+{
+    typedef typename WindowPlanes<FixedWidth, T>::plane_type plane_type;
+
+    const plane_type *red = &this->colours_.red[base];
+    const plane_type *green = &this->colours_.green[base];
+    const plane_type *blue = &this->colours_.blue[base];
+
+    aggregate_type sum_r = 0;
+    aggregate_type sum_g = 0;
+    aggregate_type sum_b = 0;
+    aggregate_type sum_sq = 0;
+
+    for (int k = 0; k < this->height_; k++)
+    {
+        const aggregate_type r = red[k];
+        const aggregate_type g = green[k];
+        const aggregate_type b = blue[k];
+
+        sum_r += r;
+        sum_g += g;
+        sum_b += b;
+        sum_sq += r*r + g*g + b*b;
+    }
+
+    this->sum_r_ += sign*sum_r;
+    this->sum_g_ += sign*sum_g;
+    this->sum_b_ += sign*sum_b;
+    this->sum_sq_ += sign*sum_sq;
+}
+
+template<int FixedWidth, typename T>
+void SlidingAggregateDistances<FixedWidth, T>::UpdateAggregates()
+{
+    // An unclamped window covers every slot, so all of the aggregates can be
+    // computed in one pass.  Otherwise only the slots in use are updated, one
+    // column at a time.
+    if (this->Count() == this->Width()*this->Width())
+    {
+        this->UpdateAggregates(0, this->Count());
+        return;
+    }
+
+    for (int xi = this->x_start_; xi <= this->x_end_; xi++)
+        this->UpdateAggregates(this->Slot(xi, 0), this->height_);
+}
+
+template<int FixedWidth, typename T>
+void SlidingAggregateDistances<FixedWidth, T>::UpdateAggregates(const int base,
+                                                                const int count)
+{
+    typedef typename WindowPlanes<FixedWidth, T>::plane_type plane_type;
+
+    const plane_type *red = &this->colours_.red[base];
+    const plane_type *green = &this->colours_.green[base];
+    const plane_type *blue = &this->colours_.blue[base];
+    aggregate_type *aggregates = &this->aggregates_[base];
+
+    // The aggregate itself always fits (see the constructor), but N*|p|^2 and
+    // 2*p.S can be larger than it, so they're computed in 64 bits.
+    const int64_t n = this->Count();
+    const int64_t sum_r = this->sum_r_;
+    const int64_t sum_g = this->sum_g_;
+    const int64_t sum_b = this->sum_b_;
+    const int64_t sum_sq = this->sum_sq_;
+
+    for (int i = 0; i < count; i++)
+    {
+        const int64_t r = red[i];
+        const int64_t g = green[i];
+        const int64_t b = blue[i];
+
+        const int64_t norm = r*r + g*g + b*b;
+        const int64_t dot = r*sum_r + g*sum_g + b*sum_b;
+        aggregates[i] = static_cast<aggregate_type>(n*norm - 2*dot + sum_sq);
+    }
+}
+
+// Widths with specialized filters, for each of the supported image depths.
+#define CHROMAVEC_INSTANTIATE(T) \
+template class SlidingAggregateDistances<kDynamicWidth, T>; \
+template class SlidingAggregateDistances<3, T>; \
+template class SlidingAggregateDistances<5, T>; \
+template class SlidingAggregateDistances<7, T>;
+
+CHROMAVEC_INSTANTIATE(uint8_t)
+CHROMAVEC_INSTANTIATE(uint16_t)
+
+#undef CHROMAVEC_INSTANTIATE
+
+}} // namespace chromavec::internal
@@ -0,0 +1,336 @@
+/**
+ * @file
+ * @brief Sliding windows that keep the aggregate distances of their pixels up
+ *      to date as they move.
+ */
+#ifndef SRC_CHROMAVEC_UTILITIES_SLIDING_WINDOW_H_
+#define SRC_CHROMAVEC_UTILITIES_SLIDING_WINDOW_H_
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include "rgbvector.h"
+
+namespace chromavec { namespace internal {
+
+/**
+ * @brief Window width used to indicate that it is only known at run time.
+ */
+constexpr int kDynamicWidth = 0;
+
+/**
+ * @brief Storage for the contents of a square window.
+ * @tparam T
+ *      element type
+ * @tparam Width
+ *      window width; the storage is only allocated at run time if it's
+ *      kDynamicWidth
+ */
+template<typename T, int Width>
+using WindowBuffer = std::conditional_t<
+    Width == kDynamicWidth,
+    std::vector<T, tbb::cache_aligned_allocator<T>>,
+    std::array<T, Width*Width>
+>;
+
+/**
+ * @brief Allocate a run-time sized window buffer.
+ */
+template<typename T>
+void AllocateWindow(std::vector<T, tbb::cache_aligned_allocator<T>> &buffer,
+                    const int width)
+{
+    buffer.resize(width*width);
+}
+
+/**
+ * @brief Fixed-size window buffers don't need to be allocated.
+ */
+template<typename T, std::size_t N>
+void AllocateWindow(std::array<T, N> &, const int)
+{
+    // do nothing
+}
+
+/**
+ * The sliding windows store their contents as three planar arrays, one per
+ * colour channel, rather than as an array of RGBVector objects.  The pixels
+ * are gathered out of the interleaved image once, when a column enters the
+ * window, and any loop over the window then works on contiguous arrays of
+ * plain integers that the compiler can vectorize.  The channels are widened to
+ * the colour's difference type (see DiffType), e.g. 16 bits for 8-bit colours,
+ * so that differences between them don't overflow.
+ *
+ * The planes are indexed by window slot.  Each image column maps onto a fixed
+ * group of `width` consecutive slots, so the pixels in a column are always
+ * contiguous.
+ *
+ * @brief Structure-of-arrays storage for the contents of a sliding window.
+ * @tparam FixedWidth
+ *      the window width, or kDynamicWidth if it is only known at run time
+ * @tparam T
+ *      the image's channel type
+ */
+template<int FixedWidth, typename T = uint8_t>
+struct WindowPlanes
+{
+    typedef typename DiffType<T>::type plane_type;
+
+    WindowBuffer<plane_type, FixedWidth> red;      ///< red channel
+    WindowBuffer<plane_type, FixedWidth> green;    ///< green channel
+    WindowBuffer<plane_type, FixedWidth> blue;     ///< blue channel
+
+    /**
+     * @brief Allocate the planes for a run-time sized window.
+     */
+    void Allocate(const int width)
+    {
+        AllocateWindow(this->red, width);
+        AllocateWindow(this->green, width);
+        AllocateWindow(this->blue, width);
+    }
+
+    /**
+     * @brief Gather part of an image column into the planes.
+     * @param img
+     *      the image being processed; must be a three channel image of `T`
+     * @param x
+     *      image column
+     * @param y_start
+     *      first image row
+     * @param height
+     *      number of rows to gather
+     * @param base
+     *      slot that the first pixel is stored in
+     */
+    void Load(const cv::Mat &img, const int x, const int y_start,
+              const int height, const int base)
+    {
+        for (int k = 0; k < height; k++)
+        {
+            const T *pixel = img.ptr<T>(y_start + k) + 3*x;
+            this->red[base + k] = pixel[0];
+            this->green[base + k] = pixel[1];
+            this->blue[base + k] = pixel[2];
+        }
+    }
+
+    /**
+     * @brief Obtain the colour stored in a slot.
+     */
+    RGBVector<T> Colour(const int slot) const
+    {
+        return RGBVector<T>(this->red[slot], this->green[slot],
+                            this->blue[slot]);
+    }
+};
+
+/**
+ * The vector order-statistic filters need the *aggregate distance* of every
+ * pixel in a window, i.e. the sum of the squared distances between that pixel
+ * and all other pixels in the window.  Expanding the squared distance gives
+ *
+ *      sum_j |p_i - p_j|^2 = N*|p_i|^2 - 2*p_i.sum_j(p_j) + sum_j |p_j|^2
+ *
+ * so the aggregate for any pixel only depends on the pixel itself and on three
+ * window-wide quantities: the number of pixels, the sum of the colours and the
+ * sum of the squared norms.  The identity is exact in integer arithmetic so
+ * the aggregates are identical to the ones from a direct evaluation.
+ *
+ * The SlidingAggregateDistances object keeps those running sums as the window
+ * moves.  When the filter moves one pixel to the right, the incoming column is
+ * added to the sums and the outgoing column is subtracted.  Any other move
+ * (e.g. a new row) rebuilds the window from scratch.  Each aggregate is then
+ * an O(1) evaluation rather than an O(N) loop over the window.
+ *
+ * The window is clamped to the image bounds in the same way as ROI.  The
+ * window contents are kept in WindowPlanes and the aggregates for the whole
+ * window are refreshed in a single pass over the planes after every move.
+ *
+ * The window width can either be given at compile time, through the template
+ * parameter, or at run time.  A compile-time width lets the compiler unroll
+ * the loops over the window and keeps the window contents in fixed-size
+ * arrays.
+ *
+ * The sums and aggregates use the colour's magnitude type (see MagType).  That
+ * is an int for 8-bit images but has to be 64 bits for 16-bit images, where a
+ * single squared distance can already overflow an int.  An 8-bit window can
+ * then be at most 104 pixels wide.
+ *
+ * @brief Incrementally maintain the aggregate distances for a sliding window.
+ * @tparam FixedWidth
+ *      the window width, or kDynamicWidth if it is only known at run time
+ * @tparam T
+ *      the image's channel type
+ */
+template<int FixedWidth = kDynamicWidth, typename T = uint8_t>
+class SlidingAggregateDistances
+{
+public:
+    typedef typename MagType<T>::type aggregate_type;
+
+    /**
+     * @brief Construct a new sliding window.
+     * @param width
+     *      width and height of the window
+     * @throws std::runtime_error
+     *      if the width doesn't match the compile-time width or the
+     *      aggregates for the width don't fit in an aggregate_type
+     */
+    SlidingAggregateDistances(const int width);
+
+    /**
+     * @brief The width of the window (ignores clamping).
+     */
+    int Width() const
+    {
+        if constexpr (FixedWidth != kDynamicWidth)
+            return FixedWidth;
+        else
+            return this->width_;
+    }
+
+    /**
+     * @brief Move the window so that it is centred on the given pixel.
+     * @param img
+     *      image being processed
+     * @param x, y
+     *      the centre of the window
+     */
+    void MoveTo(const cv::Mat &img, const int x, const int y);
+
+    /**
+     * @brief Forget the window's position so that the next move rebuilds it.
+     * @note Must be called if the contents of the image being processed
+     *      change between moves.
+     */
+    void Invalidate()
+    {
+        this->x_ = -1;
+        this->y_ = -1;
+    }
+
+    /**
+     * @brief Index of the first column in the window (in image coordinates).
+     */
+    int XStart() const { return this->x_start_; }
+
+    /**
+     * @brief Index of the last column in the window (in image coordinates).
+     */
+    int XEnd() const { return this->x_end_; }
+
+    /**
+     * @brief The height of the window (includes clamping).
+     */
+    int Height() const { return this->height_; }
+
+    /**
+     * @brief Obtain the colour of a pixel in the window.
+     * @param x
+     *      pixel column, in image coordinates
+     * @param yi
+     *      row within the window
+     */
+    RGBVector<T> Colour(const int x, const int yi) const
+    {
+        return this->colours_.Colour(this->Slot(x, yi));
+    }
+
+    /**
+     * @brief Obtain the aggregate distance of a pixel in the window.
+     * @param x
+     *      pixel column, in image coordinates
+     * @param yi
+     *      row within the window
+     */
+    aggregate_type Aggregate(const int x, const int yi) const
+    {
+        return this->aggregates_[this->Slot(x, yi)];
+    }
+
+    /**
+     * @brief The number of pixels in the window (includes clamping).
+     */
+    int Count() const
+    {
+        return (this->x_end_ - this->x_start_ + 1)*this->height_;
+    }
+
+    /**
+     * Visits every pixel in the window in row-major order by calling
+     * `visit(aggregate, colour)`.  The loops have fixed trip counts whenever
+     * the width is known at compile time and the window isn't clamped.
+     *
+     * @brief Visit all of the pixels in the window.
+     * @param visit
+     *      function called for each pixel
+     */
+    template<typename Visitor>
+    void ForEach(Visitor &&visit) const
+    {
+        if constexpr (FixedWidth != kDynamicWidth)
+        {
+            if (this->Count() == FixedWidth*FixedWidth)
+            {
+                int columns[FixedWidth];
+                for (int i = 0; i < FixedWidth; i++)
+                    columns[i] = this->Slot(this->x_start_ + i, 0);
+
+                for (int yi = 0; yi < FixedWidth; yi++)
+                    for (int i = 0; i < FixedWidth; i++)
+                    {
+                        const int slot = columns[i] + yi;
+                        visit(this->aggregates_[slot],
+                              this->colours_.Colour(slot));
+                    }
+                return;
+            }
+        }
+
+        for (int yi = 0; yi < this->height_; yi++)
+            for (int xi = this->x_start_; xi <= this->x_end_; xi++)
+            {
+                const int slot = this->Slot(xi, yi);
+                visit(this->aggregates_[slot], this->colours_.Colour(slot));
+            }
+    }
+
+    // Default copy-and-assign
+    SlidingAggregateDistances(const SlidingAggregateDistances &) = default;
+    SlidingAggregateDistances &operator=(const SlidingAggregateDistances &) = default;
+
+private:
+    int Slot(const int x, const int yi) const
+    {
+        return (x % this->Width())*this->Width() + yi;
+    }
+
+    void AddColumn(const cv::Mat &img, const int x);
+    void RemoveColumn(const int x);
+    void AccumulateColumn(const int base, const int sign);
+    void Reset();
+    void UpdateAggregates();
+    void UpdateAggregates(const int base, const int count);
+
+    int width_;
+    int x_, y_;
+    int x_start_, x_end_;
+    int y_start_, height_;
+
+    WindowPlanes<FixedWidth, T> colours_;
+    WindowBuffer<aggregate_type, FixedWidth> aggregates_;
+
+    aggregate_type sum_r_, sum_g_, sum_b_;
+    aggregate_type sum_sq_;
+};
+
+}} // namespace chromavec::internal
+
+#endif // SRC_CHROMAVEC_UTILITIES_SLIDING_WINDOW_H_
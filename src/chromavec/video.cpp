@@ -0,0 +1,342 @@
+#include "chromavec/chromavec.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <opencv2/imgproc.hpp>
+
+#include <tbb/parallel_for.h>
+
+#include "filters/canny-edges.h"
+#include "filters/gaussian.h"
+
+#include "utilities/distances.h"
+#include "utilities/filter.h"
+
+namespace chromavec {
+
+namespace {
+
+/**
+ * @brief Width and height of the tiles used to track the changes in a frame.
+ */
+constexpr int kTileSize = 32;
+
+/**
+ * @brief Number of pixels, beyond the Gaussian kernel, that affect the Canny
+ *      edge classes (one for the gradient and one for the non-maximum
+ *      suppression).
+ */
+constexpr int kCannyHalo = 2;
+
+/**
+ * @brief Find the tiles where two frames differ.
+ * @param a, b
+ *      the frames being compared; must have the same size and type
+ * @param tiles
+ *      the number of tiles along each axis
+ * @return
+ *      a row-major mask where the changed tiles are non-zero
+ */
+std::vector<uint8_t> FindChangedTiles(const cv::Mat &a, const cv::Mat &b,
+                                      const cv::Size &tiles)
+{
+    std::vector<uint8_t> changed(tiles.area(), 0);
+    const size_t pixel_bytes = a.elemSize();
+
+    tbb::parallel_for(0, tiles.height, [&](const int ty)
+    {
+        uint8_t *mask = &changed[ty*tiles.width];
+        const int y_end = std::min((ty + 1)*kTileSize, a.rows);
+
+        for (int y = ty*kTileSize; y < y_end; y++)
+        {
+            const uint8_t *row_a = a.ptr<uint8_t>(y);
+            const uint8_t *row_b = b.ptr<uint8_t>(y);
+
+            for (int tx = 0; tx < tiles.width; tx++)
+            {
+                if (mask[tx] != 0)
+                    continue;
+
+                const int x = tx*kTileSize;
+                const int width = std::min(kTileSize, a.cols - x);
+                const size_t offset = x*pixel_bytes;
+
+                if (std::memcmp(row_a + offset, row_b + offset,
+                                width*pixel_bytes) != 0)
+                    mask[tx] = 1;
+            }
+        }
+    });
+
+    return changed;
+}
+
+} // end of anonymous namespace
+
+VideoEdgeDetector::VideoEdgeDetector(const double t1, const double t2,
+                                     const double sigma,
+                                     const DistanceMetric metric)
+    : t1_(t1),
+      t2_(t2),
+      sigma_(sigma),
+      metric_(metric),
+      stamp_(0)
+{
+}
+
+const cv::Mat &VideoEdgeDetector::Detect(const cv::Mat &frame)
+{
+    if (frame.type() != CV_8UC3 && frame.type() != CV_16UC3)
+        throw std::runtime_error("Input type not supported by this filter.");
+
+    if (this->frame_.empty() || this->frame_.size() != frame.size() ||
+        this->frame_.type() != frame.type())
+    {
+        frame.copyTo(this->frame_);
+        this->DetectFull();
+        return this->edges_;
+    }
+
+    const cv::Size tiles((frame.cols + kTileSize - 1) / kTileSize,
+                         (frame.rows + kTileSize - 1) / kTileSize);
+    const std::vector<uint8_t> changed = FindChangedTiles(frame, this->frame_,
+                                                          tiles);
+    frame.copyTo(this->frame_);
+
+    // A changed pixel affects the edge classes of every pixel within the
+    // Gaussian kernel and Canny halo around it, so the tiles around a changed
+    // tile need to be updated as well.
+    const int halo = internal::PreFilterRadius(this->sigma_, frame.depth()) +
+                     kCannyHalo;
+    const int margin = (halo + kTileSize - 1) / kTileSize;
+
+    std::vector<uint8_t> update(tiles.area(), 0);
+    int num_updated = 0;
+    for (int ty = 0; ty < tiles.height; ty++)
+    {
+        for (int tx = 0; tx < tiles.width; tx++)
+        {
+            const int y0 = std::max(ty - margin, 0);
+            const int y1 = std::min(ty + margin, tiles.height - 1);
+            const int x0 = std::max(tx - margin, 0);
+            const int x1 = std::min(tx + margin, tiles.width - 1);
+
+            bool dirty = false;
+            for (int yi = y0; yi <= y1 && !dirty; yi++)
+                for (int xi = x0; xi <= x1 && !dirty; xi++)
+                    dirty = changed[yi*tiles.width + xi] != 0;
+
+            update[ty*tiles.width + tx] = dirty;
+            num_updated += dirty;
+        }
+    }
+
+    if (num_updated == 0)
+        return this->edges_;
+
+    // Past a certain point it's cheaper to just start over.
+    if (2*num_updated > tiles.area())
+    {
+        this->DetectFull();
+        return this->edges_;
+    }
+
+    // Group the tiles in each row into runs so that they can be processed as
+    // rectangles.
+    std::vector<cv::Rect> regions;
+    for (int ty = 0; ty < tiles.height; ty++)
+    {
+        const uint8_t *mask = &update[ty*tiles.width];
+        for (int tx = 0; tx < tiles.width; tx++)
+        {
+            if (mask[tx] == 0)
+                continue;
+
+            int tx_end = tx;
+            while (tx_end < tiles.width && mask[tx_end] != 0)
+                tx_end++;
+
+            const cv::Rect tile_run(tx*kTileSize, ty*kTileSize,
+                                    (tx_end - tx)*kTileSize, kTileSize);
+            regions.push_back(tile_run & cv::Rect(0, 0, frame.cols,
+                                                  frame.rows));
+            tx = tx_end;
+        }
+    }
+
+    // The classes near the edge of a region depend on the blurred pixels in
+    // the neighbouring regions, so all of the blurring has to happen first.
+    const int num_regions = static_cast<int>(regions.size());
+    if (this->sigma_ >= 0.01)
+    {
+        tbb::parallel_for(0, num_regions, [&](const int i)
+        {
+            internal::PreFilterRegion(this->frame_, this->sigma_, regions[i],
+                                      this->blurred_);
+        });
+    }
+
+    tbb::parallel_for(0, num_regions, [&](const int i)
+    {
+        this->UpdateClasses(regions[i]);
+    });
+
+    this->UpdateEdges(regions);
+    return this->edges_;
+}
+
+void VideoEdgeDetector::Reset()
+{
+    this->frame_.release();
+}
+
+void VideoEdgeDetector::DetectFull()
+{
+    using internal::CannyEdgeClasses;
+    using internal::Hysteresis;
+    using internal::PreFilter;
+
+    const cv::Mat filtered = PreFilter(this->frame_, this->sigma_,
+                                       this->blurred_);
+
+    internal::StripBuffers strips, rings;
+    internal::WithDepth(filtered.depth(), [&](auto channel)
+    {
+        internal::WithDistance(this->metric_, [&](auto distance)
+        {
+            typedef decltype(channel) T;
+            typedef decltype(distance) Distance;
+            CannyEdgeClasses<Distance, T>(filtered, this->classes_, 0,
+                                          this->t1_, this->t2_, strips, rings);
+        });
+    });
+
+    // The classes are kept around, so the hysteresis has to work on a copy.
+    this->classes_.copyTo(this->edges_);
+    internal::FloodStacks stacks;
+    Hysteresis(this->edges_, stacks);
+    cv::compare(this->edges_, 127, this->edges_, cv::CMP_GT);
+
+    this->labels_ = cv::Mat::zeros(this->frame_.size(), CV_32S);
+    this->stamp_ = 0;
+}
+
+void VideoEdgeDetector::UpdateClasses(const cv::Rect &region)
+{
+    using internal::CannyEdgeClasses;
+
+    const cv::Mat &filtered = this->sigma_ < 0.01 ? this->frame_
+                                                   : this->blurred_;
+
+    // Include enough of the surrounding pixels so that the region's classes
+    // are the same as they would be for the full frame.
+    const cv::Rect source = cv::Rect(region.x - kCannyHalo,
+                                     region.y - kCannyHalo,
+                                     region.width + 2*kCannyHalo,
+                                     region.height + 2*kCannyHalo)
+                            & cv::Rect(0, 0, filtered.cols, filtered.rows);
+
+    cv::Mat classes;
+    internal::StripBuffers strips, rings;
+    internal::WithDepth(filtered.depth(), [&](auto channel)
+    {
+        internal::WithDistance(this->metric_, [&](auto distance)
+        {
+            typedef decltype(channel) T;
+            typedef decltype(distance) Distance;
+            CannyEdgeClasses<Distance, T>(filtered(source).clone(), classes,
+                                          0, this->t1_, this->t2_, strips,
+                                          rings);
+        });
+    });
+
+    cv::Mat dst = this->classes_(region);
+    classes(cv::Rect(region.x - source.x, region.y - source.y, region.width,
+                     region.height)).copyTo(dst);
+}
+
+void VideoEdgeDetector::UpdateEdges(const std::vector<cv::Rect> &regions)
+{
+    // Recycle the stamps before they overflow.
+    if (this->stamp_ == INT_MAX)
+    {
+        this->labels_.setTo(0);
+        this->stamp_ = 0;
+    }
+    const int stamp = ++this->stamp_;
+
+    for (const cv::Rect &region : regions)
+        this->edges_(region).setTo(0);
+
+    // Any edge chain that passes through, or borders on, an updated region
+    // may have changed.  Every other chain is exactly the same as it was in
+    // the previous frame.  The affected chains are found by visiting each of
+    // their pixels and are then kept, or removed, as a whole.
+    const cv::Rect bounds(0, 0, this->classes_.cols, this->classes_.rows);
+    std::vector<cv::Point> chain;
+    std::vector<cv::Point> stack;
+
+    for (const cv::Rect &region : regions)
+    {
+        const cv::Rect seeds = cv::Rect(region.x - 1, region.y - 1,
+                                        region.width + 2, region.height + 2)
+                               & bounds;
+
+        for (int y = seeds.y; y < seeds.y + seeds.height; y++)
+        {
+            const uint8_t *classes = this->classes_.ptr<uint8_t>(y);
+            int *labels = this->labels_.ptr<int>(y);
+
+            for (int x = seeds.x; x < seeds.x + seeds.width; x++)
+            {
+                if (classes[x] == 0 || labels[x] == stamp)
+                    continue;
+
+                // Collect the entire (8-connected) chain.
+                bool strong = false;
+                chain.clear();
+                labels[x] = stamp;
+                stack.emplace_back(x, y);
+
+                while (!stack.empty())
+                {
+                    const cv::Point p = stack.back();
+                    stack.pop_back();
+                    chain.push_back(p);
+
+                    strong |= this->classes_.at<uint8_t>(p) == 255;
+
+                    const int y0 = std::max(p.y - 1, 0);
+                    const int y1 = std::min(p.y + 1, bounds.height - 1);
+                    const int x0 = std::max(p.x - 1, 0);
+                    const int x1 = std::min(p.x + 1, bounds.width - 1);
+
+                    for (int yi = y0; yi <= y1; yi++)
+                    {
+                        const uint8_t *row = this->classes_.ptr<uint8_t>(yi);
+                        int *label = this->labels_.ptr<int>(yi);
+                        for (int xi = x0; xi <= x1; xi++)
+                        {
+                            if (row[xi] != 0 && label[xi] != stamp)
+                            {
+                                label[xi] = stamp;
+                                stack.emplace_back(xi, yi);
+                            }
+                        }
+                    }
+                }
+
+                // Weak edges are only kept if the chain has a strong edge.
+                const uint8_t value = strong ? 255 : 0;
+                for (const cv::Point &p : chain)
+                    this->edges_.at<uint8_t>(p) = value;
+            }
+        }
+    }
+}
+
+} // namespace chromavec
@@ -0,0 +1,49 @@
+/**
+ * @file
+ * @brief Check that the Vector Median filter's histogram search produces the
+ *      same output as its window search.
+ */
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include <chromavec/chromavec.h>
+
+#include "test-utils.h"
+
+int main()
+{
+    testutils::TestRun run;
+
+    // A handful of levels gives windows with many identical colours, where the
+    // two searches must break the ties the same way.
+    unsigned seed = 1;
+    for (const cv::Size &size : testutils::TestSizes())
+    {
+        for (const int levels : {0, 2, 3, 16})
+        {
+            const cv::Mat img = testutils::RandomImage(size, CV_8UC3, seed++,
+                                                       levels);
+
+            for (const int window : {3, 5, 9, 15, 21})
+            {
+                const cv::Mat expected = chromavec::VectorMedianFilter(
+                    img, window, chromavec::kSearchWindow
+                );
+                const cv::Mat filtered = chromavec::VectorMedianFilter(
+                    img, window, chromavec::kSearchHistogram
+                );
+
+                run.Check(
+                    testutils::Identical(filtered, expected),
+                    "Histogram search " + testutils::ToString(size)
+                    + " window " + std::to_string(window)
+                    + (levels > 0 ? " with " + std::to_string(levels)
+                                    + " levels" : "")
+                );
+            }
+        }
+    }
+
+    return run.Finish();
+}
@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief Check that the operators with a padded border produce the same output
+ *      as their clamped, per-pixel operators.
+ */
+#include <cstdint>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "filters/canny-edges.h"
+#include "utilities/distances.h"
+#include "utilities/filter.h"
+
+#include "test-utils.h"
+
+// Internal functions
+namespace {
+
+using namespace chromavec::internal;
+
+/**
+ * The per-pixel operator clamps its coordinates to the image bounds, which is
+ * how all of the operators worked before they could ask for a border.
+ *
+ * @brief Apply an operator one pixel at a time, without any padding.
+ */
+template<typename Operator>
+cv::Mat ClampedFilter(const cv::Mat &img)
+{
+    typedef typename OpenCVTypeInfo<Operator::output_type>::type out_type;
+
+    const Operator op;
+    cv::Mat out(img.rows, img.cols, Operator::output_type);
+    for (int y = 0; y < img.rows; y++)
+    {
+        out_type *row = out.ptr<out_type>(y);
+        for (int x = 0; x < img.cols; x++)
+            row[x] = static_cast<out_type>(op(x, y, img).red);
+    }
+
+    return out;
+}
+
+template<typename Distance, typename T>
+void CheckGradients(testutils::TestRun &run, const std::string &name)
+{
+    unsigned seed = 1;
+    for (const cv::Size &size : testutils::TestSizes())
+    {
+        const cv::Mat img = testutils::RandomImage(size, RGBImageType<T>::value,
+                                                   seed++);
+        const std::string what = name + " " + testutils::ToString(size);
+
+        const cv::Mat gradient = Filter<ColourGradient<Distance, T>>(img);
+        run.Check(
+            testutils::Identical(gradient,
+                                 ClampedFilter<ColourGradient<Distance, T>>(img)),
+            "ColourGradient " + what
+        );
+
+        const cv::Mat nms = Filter<NonMaximumSupression<T>>(gradient);
+        run.Check(
+            testutils::Identical(nms,
+                                 ClampedFilter<NonMaximumSupression<T>>(gradient)),
+            "NonMaximumSupression " + what
+        );
+    }
+}
+
+} // end of anonymous namespace
+
+int main()
+{
+    testutils::TestRun run;
+
+    CheckGradients<SquaredEuclideanDistance, uint8_t>(run, "Euclidean 8-bit");
+    CheckGradients<ManhattanDistance, uint8_t>(run, "Manhattan 8-bit");
+    CheckGradients<ChebyshevDistance, uint8_t>(run, "Chebyshev 8-bit");
+    CheckGradients<SquaredEuclideanDistance, uint16_t>(run, "Euclidean 16-bit");
+    CheckGradients<ManhattanDistance, uint16_t>(run, "Manhattan 16-bit");
+    CheckGradients<ChebyshevDistance, uint16_t>(run, "Chebyshev 16-bit");
+
+    return run.Finish();
+}
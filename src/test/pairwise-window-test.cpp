@@ -0,0 +1,242 @@
+/**
+ * @file
+ * @brief Check the sliding windows' aggregate distances against a direct
+ *      evaluation over every pair of pixels in the window.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "utilities/distances.h"
+#include "utilities/filter.h"
+#include "utilities/pairwise-window.h"
+#include "utilities/sliding-window.h"
+
+#include "test-utils.h"
+
+// Internal functions
+namespace {
+
+using namespace chromavec::internal;
+
+template<typename T>
+bool SameColour(const RGBVector<T> &a, const RGBVector<T> &b)
+{
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+/**
+ * @brief Check that a window's aggregates match a direct O(N^2) evaluation.
+ * @param window
+ *      the sliding window, already moved to (x, y)
+ * @param img
+ *      the image being processed
+ * @param x, y
+ *      the centre of the window
+ * @return
+ *      true if the window extents and every aggregate are correct
+ */
+template<typename Distance, typename T, typename Window>
+bool MatchesDirect(const Window &window, const cv::Mat &img, const int x,
+                   const int y)
+{
+    const int half = window.Width()/2;
+    const int x0 = std::clamp(x - half, 0, img.cols - 1);
+    const int x1 = std::clamp(x + half, 0, img.cols - 1);
+    const int y0 = std::clamp(y - half, 0, img.rows - 1);
+    const int y1 = std::clamp(y + half, 0, img.rows - 1);
+
+    if (window.XStart() != x0 || window.XEnd() != x1 ||
+        window.Height() != y1 - y0 + 1 ||
+        window.Count() != (x1 - x0 + 1)*(y1 - y0 + 1))
+    {
+        return false;
+    }
+
+    const Distance distance;
+    for (int yi = 0; yi <= y1 - y0; yi++)
+    {
+        for (int xi = x0; xi <= x1; xi++)
+        {
+            const RGBVector<T> p(img, xi, y0 + yi);
+
+            typename Window::aggregate_type expected = 0;
+            for (int yj = y0; yj <= y1; yj++)
+                for (int xj = x0; xj <= x1; xj++)
+                    expected += distance(p, RGBVector<T>(img, xj, yj));
+
+            if (window.Aggregate(xi, yi) != expected ||
+                !SameColour(window.Colour(xi, yi), p))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * The window is moved through the image in raster order, which uses the
+ * incremental updates, and then in reverse, which rebuilds it at every pixel.
+ *
+ * @brief Check a sliding window over a set of test images.
+ */
+template<typename Window, typename Distance, typename T>
+void CheckWindow(testutils::TestRun &run, const std::string &name,
+                 const int width)
+{
+    unsigned seed = 1;
+    for (const cv::Size &size : testutils::TestSizes())
+    {
+        for (const int levels : {0, 3})
+        {
+            const cv::Mat img = testutils::RandomImage(
+                size, RGBImageType<T>::value, seed++, levels
+            );
+
+            Window window(width);
+            bool forward = true;
+            for (int y = 0; y < img.rows; y++)
+                for (int x = 0; x < img.cols; x++)
+                {
+                    window.MoveTo(img, x, y);
+                    forward &= MatchesDirect<Distance, T>(window, img, x, y);
+                }
+
+            bool reverse = true;
+            for (int y = img.rows - 1; y >= 0; y--)
+                for (int x = img.cols - 1; x >= 0; x--)
+                {
+                    window.MoveTo(img, x, y);
+                    reverse &= MatchesDirect<Distance, T>(window, img, x, y);
+                }
+
+            const std::string what = name + " width " + std::to_string(width)
+                                     + " " + testutils::ToString(size)
+                                     + (levels > 0 ? " with ties" : "");
+            run.Check(forward, what + " (raster order)");
+            run.Check(reverse, what + " (reverse order)");
+        }
+    }
+}
+
+template<typename Distance, typename T>
+void CheckPairwise(testutils::TestRun &run, const std::string &name)
+{
+    CheckWindow<SlidingPairwiseDistances<Distance, 3, T>, Distance, T>(
+        run, name + " fixed", 3
+    );
+    CheckWindow<SlidingPairwiseDistances<Distance, 5, T>, Distance, T>(
+        run, name + " fixed", 5
+    );
+    CheckWindow<SlidingPairwiseDistances<Distance, 7, T>, Distance, T>(
+        run, name + " fixed", 7
+    );
+
+    for (const int width : {1, 3, 5, 9, 15})
+    {
+        CheckWindow<SlidingPairwiseDistances<Distance, kDynamicWidth, T>,
+                    Distance, T>(run, name, width);
+    }
+}
+
+/**
+ * @brief Check that a window too large for the pair buffer is rejected.
+ */
+void CheckWidthLimit(testutils::TestRun &run)
+{
+    bool rejected = false;
+    try
+    {
+        // The window's area doesn't fit in an 'int'.
+        SlidingPairwiseDistances<ManhattanDistance> window(46341);
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+    run.Check(rejected, "Pairwise window width 46341");
+}
+
+/**
+ * The widest 8-bit window that the filters can use has aggregates close to
+ * INT_MAX, while the terms of the closed form overflow an 'int' before they're
+ * added up.
+ *
+ * @brief Check the closed form at the largest odd width it accepts.
+ */
+void CheckClosedFormLimit(testutils::TestRun &run)
+{
+    constexpr int kWidth = 103;
+    constexpr int kCount = kWidth*kWidth;
+    constexpr int kMax = 3*255*255;
+
+    // A single black pixel in a white image.
+    cv::Mat img(kWidth, kWidth, CV_8UC3, cv::Scalar::all(255));
+    img.at<cv::Vec3b>(0, 0) = cv::Vec3b(0, 0, 0);
+
+    SlidingAggregateDistances<kDynamicWidth, uint8_t> window(kWidth);
+    window.MoveTo(img, kWidth/2, kWidth/2);
+    run.Check(window.Count() == kCount &&
+              window.Aggregate(0, 0) == (kCount - 1)*kMax &&
+              window.Aggregate(1, 0) == kMax,
+              "Closed-form Euclidean 8-bit width 103");
+
+    bool rejected = false;
+    try
+    {
+        SlidingAggregateDistances<kDynamicWidth, uint8_t> window(kWidth + 2);
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+    run.Check(rejected, "Closed-form Euclidean 8-bit width 105");
+}
+
+template<typename T>
+void CheckClosedForm(testutils::TestRun &run, const std::string &name)
+{
+    typedef SquaredEuclideanDistance Distance;
+
+    CheckWindow<SlidingAggregateDistances<3, T>, Distance, T>(
+        run, name + " fixed", 3
+    );
+    CheckWindow<SlidingAggregateDistances<5, T>, Distance, T>(
+        run, name + " fixed", 5
+    );
+    CheckWindow<SlidingAggregateDistances<7, T>, Distance, T>(
+        run, name + " fixed", 7
+    );
+
+    for (const int width : {1, 3, 5, 9, 15})
+    {
+        CheckWindow<SlidingAggregateDistances<kDynamicWidth, T>, Distance, T>(
+            run, name, width
+        );
+    }
+}
+
+} // end of anonymous namespace
+
+int main()
+{
+    testutils::TestRun run;
+
+    CheckPairwise<SquaredEuclideanDistance, uint8_t>(run, "Pairwise Euclidean 8-bit");
+    CheckPairwise<ManhattanDistance, uint8_t>(run, "Pairwise Manhattan 8-bit");
+    CheckPairwise<ChebyshevDistance, uint8_t>(run, "Pairwise Chebyshev 8-bit");
+    CheckPairwise<ManhattanDistance, uint16_t>(run, "Pairwise Manhattan 16-bit");
+    CheckPairwise<ChebyshevDistance, uint16_t>(run, "Pairwise Chebyshev 16-bit");
+    CheckWidthLimit(run);
+
+    CheckClosedForm<uint8_t>(run, "Closed-form Euclidean 8-bit");
+    CheckClosedForm<uint16_t>(run, "Closed-form Euclidean 16-bit");
+    CheckClosedFormLimit(run);
+
+    return run.Finish();
+}
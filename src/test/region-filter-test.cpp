@@ -0,0 +1,167 @@
+/**
+ * @file
+ * @brief Check that filtering regions of an image, or only the changed parts of
+ *      a video frame, produces the same output as filtering the whole image.
+ */
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <chromavec/chromavec.h>
+
+#include "test-utils.h"
+
+// Internal functions
+namespace {
+
+using namespace chromavec;
+
+/**
+ * Random pixels produce edges everywhere, so the test images are made of
+ * large blocks of colour with some noise on top.
+ *
+ * @brief Generate a test image with some structure to it.
+ */
+cv::Mat BlockImage(const cv::Size &size, const int depth, const unsigned seed)
+{
+    const int scale = depth == CV_16U ? 257 : 1;
+    const cv::Mat noise = testutils::RandomImage(size, CV_MAKETYPE(depth, 3),
+                                                 seed, 16);
+
+    cv::Mat img(size, CV_MAKETYPE(depth, 3));
+    for (int y = 0; y < size.height; y++)
+    {
+        for (int x = 0; x < 3*size.width; x++)
+        {
+            const int block = ((x/3)/11 + y/7 + x%3) % 3;
+            if (depth == CV_16U)
+            {
+                img.ptr<uint16_t>(y)[x] = static_cast<uint16_t>(
+                    scale*80*block + noise.ptr<uint16_t>(y)[x]/16
+                );
+            }
+            else
+            {
+                img.ptr<uint8_t>(y)[x] = static_cast<uint8_t>(
+                    80*block + noise.ptr<uint8_t>(y)[x]/16
+                );
+            }
+        }
+    }
+
+    return img;
+}
+
+void CheckRegions(testutils::TestRun &run, const int depth,
+                  const std::string &name)
+{
+    const std::vector<std::pair<std::string, FilterSpec>> specs = {
+        {"VectorMedian", FilterSpec::VectorMedian(5)},
+        {"ColourGradient", FilterSpec::ColourGradient(0, kDirectOutput)},
+        {"ColourGradient Gaussian",
+         FilterSpec::ColourGradient(1.5, kDirectOutput)},
+        {"ColourGradient wide Gaussian",
+         FilterSpec::ColourGradient(2.9, kDirectOutput)},
+        {"ColourGradient box cascade",
+         FilterSpec::ColourGradient(4.5, kDirectOutput)},
+        {"ColourGradient magnitude",
+         FilterSpec::ColourGradient(1.5, kMagnitudeOnly)}
+    };
+
+    const std::vector<cv::Rect> regions = {
+        cv::Rect(20, 15, 9, 11), cv::Rect(0, 0, 5, 5), cv::Rect(60, 40, 30, 30),
+        cv::Rect(33, 0, 1, 50), cv::Rect(40, 25, 1, 1)
+    };
+
+    const cv::Mat img = BlockImage(cv::Size(71, 53), depth, 7);
+    for (const auto &entry : specs)
+    {
+        const cv::Mat expected = ApplyFilter(img, entry.second);
+        for (const cv::Rect &region : regions)
+        {
+            Workspace workspace;
+            cv::Mat out;
+            ApplyFilter(img, out, workspace, entry.second, region);
+
+            const cv::Rect target = region & cv::Rect(0, 0, img.cols, img.rows);
+            const std::string what = name + " " + entry.first
+                                     + " region at ("
+                                     + std::to_string(region.x) + ", "
+                                     + std::to_string(region.y) + ")";
+            run.Check(testutils::Identical(out(target), expected(target)),
+                      what);
+
+            // The output was allocated by the call, so everything outside of
+            // the region has to be zero.
+            cv::Mat outside = out.clone();
+            outside(target).setTo(cv::Scalar::all(0));
+            run.Check(cv::norm(outside, cv::NORM_INF) == 0,
+                      what + " is zero outside of the region");
+        }
+
+        // Regions of different sizes share one workspace.
+        Workspace workspace;
+        cv::Mat out;
+        ApplyFilter(img, out, workspace, entry.second, regions);
+
+        bool matches = true;
+        for (const cv::Rect &region : regions)
+        {
+            const cv::Rect target = region & cv::Rect(0, 0, img.cols, img.rows);
+            matches &= testutils::Identical(out(target), expected(target));
+        }
+        run.Check(matches, name + " " + entry.first + " shared workspace");
+    }
+}
+
+void CheckVideo(testutils::TestRun &run, const int depth,
+                const std::string &name)
+{
+    const double scale = depth == CV_16U ? 257 : 1;
+    const double t1 = 10*scale;
+    const double t2 = 30*scale;
+
+    for (const double sigma : {0.0, 1.5, 2.9, 4.5})
+    {
+        VideoEdgeDetector detector(t1, t2, sigma);
+        cv::Mat frame = BlockImage(cv::Size(150, 110), depth, 11);
+
+        std::mt19937 rng(3);
+        bool matches = true;
+        for (int i = 0; i < 6; i++)
+        {
+            // Change a few small patches between frames.
+            for (int k = 0; k < 3; k++)
+            {
+                const cv::Rect patch(rng() % (frame.cols - 4),
+                                     rng() % (frame.rows - 4), 4, 4);
+                frame(patch).setTo(0);
+            }
+
+            const cv::Mat expected = ColourCannyEdgeDetect(frame, t1, t2,
+                                                           sigma);
+            matches &= testutils::Identical(detector.Detect(frame), expected);
+        }
+
+        run.Check(matches, name + " VideoEdgeDetector with sigma " +
+                           std::to_string(sigma));
+    }
+}
+
+} // end of anonymous namespace
+
+int main()
+{
+    testutils::TestRun run;
+
+    CheckRegions(run, CV_8U, "8-bit");
+    CheckRegions(run, CV_16U, "16-bit");
+    CheckVideo(run, CV_8U, "8-bit");
+    CheckVideo(run, CV_16U, "16-bit");
+
+    return run.Finish();
+}
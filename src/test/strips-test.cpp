@@ -0,0 +1,123 @@
+/**
+ * @file
+ * @brief Check that filtering an image in strips produces the same output as
+ *      filtering the whole image.
+ */
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <chromavec/chromavec.h>
+
+#include "test-utils.h"
+
+// Internal functions
+namespace {
+
+/**
+ * @brief Check if every non-zero pixel in one image is also set in another.
+ */
+bool IsSubset(const cv::Mat &a, const cv::Mat &b)
+{
+    if (a.size() != b.size() || a.type() != CV_8UC1 || b.type() != CV_8UC1)
+        return false;
+
+    for (int y = 0; y < a.rows; y++)
+    {
+        const uint8_t *row_a = a.ptr<uint8_t>(y);
+        const uint8_t *row_b = b.ptr<uint8_t>(y);
+        for (int x = 0; x < a.cols; x++)
+        {
+            if (row_a[x] != 0 && row_b[x] == 0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief The filters being checked, with the Canny thresholds scaled for the
+ *      image depth.
+ */
+std::vector<std::pair<std::string, chromavec::FilterSpec>> Specs(
+    const int depth)
+{
+    using namespace chromavec;
+
+    const double scale = depth == CV_16U ? 257 : 1;
+    return {
+        {"VectorMedian", FilterSpec::VectorMedian(5)},
+        {"VectorMedian histogram",
+         FilterSpec::VectorMedian(15, kSearchHistogram)},
+        {"VectorRange", FilterSpec::VectorRange(7, kManhattan)},
+        {"MinimumVectorDispersion", FilterSpec::MinimumVectorDispersion()},
+        {"ColourGradient", FilterSpec::ColourGradient(0, kDirectOutput)},
+        {"ColourGradient Gaussian",
+         FilterSpec::ColourGradient(1.5, kMagnitudeOnly)},
+        {"ColourGradient box cascade", FilterSpec::ColourGradient(4.5)},
+        {"CannyEdges", FilterSpec::CannyEdges(10*scale, 20*scale, 1.0)},
+        {"CannyEdges box cascade",
+         FilterSpec::CannyEdges(10*scale, 20*scale, 4.0)}
+    };
+}
+
+} // end of anonymous namespace
+
+int main()
+{
+    using namespace chromavec;
+
+    // None of the heights are a multiple of the strip sizes, so the last
+    // strip is always a partial one.
+    const std::vector<cv::Size> sizes = {
+        cv::Size(23, 37), cv::Size(40, 61), cv::Size(7, 101)
+    };
+
+    testutils::TestRun run;
+
+    unsigned seed = 1;
+    for (const int type : {CV_8UC3, CV_16UC3})
+    {
+        const std::string depth = type == CV_8UC3 ? " 8-bit " : " 16-bit ";
+        for (const cv::Size &size : sizes)
+        {
+            const cv::Mat img = testutils::RandomImage(size, type, seed++, 8);
+            for (const auto &entry : Specs(CV_MAT_DEPTH(type)))
+            {
+                const cv::Mat expected = ApplyFilter(img, entry.second);
+                for (const int strip_rows : {1, 5, 16, 200})
+                {
+                    cv::Mat filtered;
+                    FilterStrips(entry.second, img.size(),
+                                 ImageRowSource(img),
+                                 ImageRowSink(filtered, img.size()),
+                                 strip_rows, type);
+
+                    const std::string what = entry.first + depth
+                                             + testutils::ToString(size)
+                                             + " in strips of "
+                                             + std::to_string(strip_rows);
+
+                    // The hysteresis only follows weak edges within a strip
+                    // and its halo, so some weak edges can go missing.
+                    if (entry.second.type == kCannyEdges &&
+                        strip_rows < size.height)
+                    {
+                        run.Check(IsSubset(filtered, expected), what);
+                    }
+                    else
+                    {
+                        run.Check(testutils::Identical(filtered, expected),
+                                  what);
+                    }
+                }
+            }
+        }
+    }
+
+    return run.Finish();
+}
@@ -0,0 +1,156 @@
+/**
+ * @file
+ * @brief Helpers shared by the chromavec tests.
+ */
+#ifndef SRC_TEST_TEST_UTILS_H_
+#define SRC_TEST_TEST_UTILS_H_
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace testutils {
+
+/**
+ * The sizes are deliberately awkward: single rows and columns, odd sizes and
+ * sizes that aren't a multiple of any tile or window size.
+ *
+ * @brief Image sizes used by the tests.
+ */
+inline std::vector<cv::Size> TestSizes()
+{
+    return {
+        cv::Size(1, 1), cv::Size(9, 1), cv::Size(1, 9), cv::Size(2, 3),
+        cv::Size(13, 17), cv::Size(45, 31), cv::Size(33, 64)
+    };
+}
+
+/**
+ * Using only a few levels per channel produces lots of repeated colours, and
+ * therefore lots of ties between the pixels in a window.
+ *
+ * @brief Generate a reproducible random image.
+ * @param size
+ *      image size
+ * @param type
+ *      image type; must be an 8-bit or 16-bit unsigned image
+ * @param seed
+ *      seed for the random number generator
+ * @param levels
+ *      number of distinct values in each channel, spread out over the
+ *      channel's full range; '0' uses every possible value
+ */
+inline cv::Mat RandomImage(const cv::Size &size, const int type,
+                           const unsigned seed, const int levels = 0)
+{
+    cv::Mat img(size, type);
+
+    const int max = img.depth() == CV_16U ? 65535 : 255;
+    const int count = levels > 1 ? levels : max + 1;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> value(0, count - 1);
+
+    const int values = img.cols*img.channels();
+    for (int y = 0; y < img.rows; y++)
+    {
+        for (int i = 0; i < values; i++)
+        {
+            const int v = count > max ? value(rng) : value(rng)*max/(count - 1);
+            switch (img.depth())
+            {
+                case CV_8U:
+                    img.ptr<uint8_t>(y)[i] = static_cast<uint8_t>(v);
+                    break;
+                case CV_16U:
+                    img.ptr<uint16_t>(y)[i] = static_cast<uint16_t>(v);
+                    break;
+                default:
+                    throw std::runtime_error("Unsupported test image type.");
+            }
+        }
+    }
+
+    return img;
+}
+
+/**
+ * @brief Check if two images have the same size, type and contents.
+ */
+inline bool Identical(const cv::Mat &a, const cv::Mat &b)
+{
+    if (a.size() != b.size() || a.type() != b.type())
+        return false;
+
+    const size_t row_bytes = a.cols*a.elemSize();
+    for (int y = 0; y < a.rows; y++)
+    {
+        if (std::memcmp(a.ptr(y), b.ptr(y), row_bytes) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Describe an image size, e.g. "13x17".
+ */
+inline std::string ToString(const cv::Size &size)
+{
+    return std::to_string(size.width) + "x" + std::to_string(size.height);
+}
+
+/**
+ * @brief Keeps track of the checks made by a test program.
+ */
+class TestRun
+{
+public:
+    TestRun()
+        : checks_(0),
+          failures_(0)
+    {
+    }
+
+    /**
+     * @brief Record the result of a check.
+     * @param passed
+     *      if the check passed
+     * @param what
+     *      description of the check, printed if it fails
+     */
+    void Check(const bool passed, const std::string &what)
+    {
+        this->checks_++;
+        if (!passed)
+        {
+            this->failures_++;
+            std::cerr << "FAILED: " << what << "\n";
+        }
+    }
+
+    /**
+     * @brief Print a summary of the checks.
+     * @return
+     *      the exit code for the test program
+     */
+    int Finish() const
+    {
+        std::cout << this->checks_ - this->failures_ << " of " << this->checks_
+                  << " checks passed\n";
+        return this->failures_ == 0 ? 0 : 1;
+    }
+
+private:
+    int checks_;
+    int failures_;
+};
+
+} // namespace testutils
+
+#endif // SRC_TEST_TEST_UTILS_H_
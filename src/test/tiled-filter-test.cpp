@@ -0,0 +1,259 @@
+/**
+ * @file
+ * @brief Check that the tiled filter driver produces the same output for any
+ *      tile layout.
+ */
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <chromavec/chromavec.h>
+
+#include "filters/canny-edges.h"
+#include "filters/minimum-vector-dispersion.h"
+#include "filters/vector-range.h"
+#include "filters/vmf.h"
+#include "utilities/distances.h"
+#include "utilities/filter.h"
+
+#include "test-utils.h"
+
+// Internal functions
+namespace {
+
+using namespace chromavec::internal;
+
+/**
+ * The layouts include single rows and columns of pixels, odd sizes that don't
+ * divide the test images, tiles larger than any of the images and automatic
+ * sizes.
+ *
+ * @brief Tile layouts used by the tests.
+ */
+std::vector<TileLayout> TestLayouts()
+{
+    const Partitioner partitioners[] = {
+        Partitioner::kAuto, Partitioner::kSimple, Partitioner::kStatic
+    };
+    const std::vector<cv::Size> sizes = {
+        cv::Size(1, 1), cv::Size(7, 1), cv::Size(1, 7), cv::Size(64, 1),
+        cv::Size(1, 64), cv::Size(5, 3), cv::Size(16, 7), cv::Size(100, 100),
+        cv::Size(0, 0), cv::Size(3, 0), cv::Size(0, 5)
+    };
+
+    std::vector<TileLayout> layouts;
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        TileLayout layout;
+        layout.rows = sizes[i].height;
+        layout.cols = sizes[i].width;
+        layout.partitioner = partitioners[i % 3];
+        layouts.push_back(layout);
+    }
+
+    return layouts;
+}
+
+/**
+ * @brief Apply an operator onto the whole image in raster order, without any
+ *      tiles.
+ */
+template<typename Operator, typename ...Args>
+cv::Mat Untiled(const cv::Mat &img, const Args &...args)
+{
+    typedef typename OpenCVTypeInfo<Operator::output_type>::type out_type;
+    constexpr int channels = OpenCVTypeInfo<Operator::output_type>::channels;
+
+    Operator op(args...);
+    cv::Mat out(img.rows, img.cols, Operator::output_type);
+    for (int y = 0; y < img.rows; y++)
+    {
+        out_type *row = out.ptr<out_type>(y);
+        for (int x = 0; x < img.cols; x++)
+        {
+            const auto colour = op(x, y, img);
+            row[channels*x] = static_cast<out_type>(colour.red);
+            if constexpr (channels == 3)
+            {
+                row[channels*x + 1] = static_cast<out_type>(colour.green);
+                row[channels*x + 2] = static_cast<out_type>(colour.blue);
+            }
+        }
+    }
+
+    return out;
+}
+
+/**
+ * The same tile buffers are reused for every layout, so they have to grow, and
+ * be reused, as the layouts change.
+ *
+ * @brief Check an operator over every test layout.
+ */
+template<typename Operator, typename ...Args>
+void CheckOperator(testutils::TestRun &run, const std::string &name,
+                   const cv::Mat &img, const Args &...args)
+{
+    const std::string what = name + " " + testutils::ToString(img.size());
+
+    const cv::Mat expected = Filter<Operator>(img, args...);
+    run.Check(testutils::Identical(expected, Untiled<Operator>(img, args...)),
+              what + " untiled");
+
+    TileBuffers buffers;
+    OperatorCache operators;
+    for (const TileLayout &layout : TestLayouts())
+    {
+        // Any pixel that's missed keeps its initial value.
+        cv::Mat filtered(img.rows, img.cols, Operator::output_type);
+        filtered.setTo(123);
+
+        FilterTiles<Operator>(filtered, img, layout, buffers, operators,
+                              args...);
+        run.Check(testutils::Identical(filtered, expected),
+                  what + " in " + std::to_string(layout.cols) + "x"
+                  + std::to_string(layout.rows) + " tiles");
+    }
+}
+
+/**
+ * @brief Check the operators with a border, a halo and neither.
+ */
+template<typename Distance, typename T>
+void CheckOperators(testutils::TestRun &run, const std::string &name)
+{
+    unsigned seed = 1;
+    for (const cv::Size &size : testutils::TestSizes())
+    {
+        const cv::Mat img = testutils::RandomImage(size, RGBImageType<T>::value,
+                                                   seed++, 6);
+
+        // Operators with a border.
+        CheckOperator<ColourGradient<Distance, T>>(
+            run, name + " ColourGradient", img
+        );
+        const cv::Mat gradient = Filter<ColourGradient<Distance, T>>(img);
+        CheckOperator<NonMaximumSupression<T>>(
+            run, name + " NonMaximumSupression", gradient
+        );
+
+        // Operators with a halo.
+        CheckOperator<VMFilter<Distance, kDynamicWidth, T>>(
+            run, name + " VMFilter", img, 5
+        );
+        CheckOperator<VMFilter<Distance, 3, T>>(
+            run, name + " VMFilter fixed", img, 3
+        );
+        CheckOperator<VectorRangeFilter<Distance, kDynamicWidth, T>>(
+            run, name + " VectorRangeFilter", img, 9
+        );
+        CheckOperator<MinVecDispersionFilter<Distance, 7, T>>(
+            run, name + " MinVecDispersionFilter", img, 7, 3, 4
+        );
+
+        // Operators with neither.
+        CheckOperator<GradientToMagnitude<T>>(
+            run, name + " GradientToMagnitude", gradient
+        );
+        CheckOperator<GradientToHSV<T>>(run, name + " GradientToHSV",
+                                        gradient);
+        CheckOperator<Threshold<T>>(run, name + " Threshold", gradient, 10.0f,
+                                    20.0f);
+
+        if constexpr (std::is_same<T, uint8_t>::value &&
+                      std::is_same<Distance, SquaredEuclideanDistance>::value)
+        {
+            CheckOperator<HistogramVMFilter>(run, name + " HistogramVMFilter",
+                                             img, 7);
+        }
+    }
+}
+
+/**
+ * @brief Check that the filters follow the tiling set on the workspace.
+ */
+void CheckWorkspaceTiling(testutils::TestRun &run)
+{
+    const cv::Mat img = testutils::RandomImage(cv::Size(45, 31), CV_8UC3, 99);
+    const cv::Mat expected = chromavec::VectorMedianFilter(img, 5);
+
+    chromavec::Workspace workspace;
+    workspace.tiling.rows = 3;
+    workspace.tiling.cols = 5;
+    workspace.tiling.partitioner = chromavec::kPartitionSimple;
+
+    cv::Mat filtered;
+    chromavec::VectorMedianFilter(img, filtered, workspace, 5);
+    run.Check(testutils::Identical(filtered, expected),
+              "VectorMedianFilter with a 5x3 workspace tiling");
+
+    bool rejected = false;
+    workspace.tiling.rows = -1;
+    try
+    {
+        chromavec::VectorMedianFilter(img, filtered, workspace, 5);
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+    run.Check(rejected, "VectorMedianFilter with a negative tile size");
+}
+
+/**
+ * @brief Check that a workspace gives the same results when it's reused for
+ *      different images.
+ */
+void CheckWorkspaceReuse(testutils::TestRun &run)
+{
+    // The first two images have the same size, so the second one reuses all
+    // of the buffers.
+    chromavec::Workspace workspace;
+    unsigned seed = 7;
+    for (const cv::Size &size : {cv::Size(45, 31), cv::Size(45, 31),
+                                 cv::Size(20, 70)})
+    {
+        const cv::Mat img = testutils::RandomImage(size, CV_8UC3, seed++, 6);
+        const std::string what = " reusing a workspace for "
+                                  + testutils::ToString(size);
+        cv::Mat filtered;
+
+        chromavec::VectorMedianFilter(img, filtered, workspace, 5);
+        run.Check(testutils::Identical(filtered,
+                                       chromavec::VectorMedianFilter(img, 5)),
+                  "VectorMedianFilter" + what);
+
+        chromavec::MinimumVectorDispersionFilter(img, filtered, workspace, 3,
+                                                 4, 9, chromavec::kManhattan);
+        run.Check(testutils::Identical(
+                      filtered,
+                      chromavec::MinimumVectorDispersionFilter(
+                          img, 3, 4, 9, chromavec::kManhattan)),
+                  "MinimumVectorDispersionFilter" + what);
+
+        chromavec::ColourCannyEdgeDetect(img, filtered, workspace, 10, 20, 4);
+        run.Check(testutils::Identical(
+                      filtered,
+                      chromavec::ColourCannyEdgeDetect(img, 10, 20, 4)),
+                  "ColourCannyEdgeDetect" + what);
+    }
+}
+
+} // end of anonymous namespace
+
+int main()
+{
+    testutils::TestRun run;
+
+    CheckOperators<SquaredEuclideanDistance, uint8_t>(run, "Euclidean 8-bit");
+    CheckOperators<ManhattanDistance, uint8_t>(run, "Manhattan 8-bit");
+    CheckOperators<ChebyshevDistance, uint16_t>(run, "Chebyshev 16-bit");
+    CheckWorkspaceTiling(run);
+    CheckWorkspaceReuse(run);
+
+    return run.Finish();
+}
@@ -0,0 +1,150 @@
+/**
+ * @file
+ * @brief Check that the incremental video edge detector produces the same edges
+ *      as running the full detector on every frame.
+ */
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <chromavec/chromavec.h>
+
+#include "test-utils.h"
+
+// Internal functions
+namespace {
+
+using namespace chromavec;
+
+// The colours used to draw the frames, in 8-bit units.
+constexpr int kTop = 20;
+constexpr int kWeak = 50;
+constexpr int kStrong = 250;
+
+// Hysteresis thresholds, in 8-bit units.  The step between kTop and kWeak is
+// a weak edge and the step between kTop and kStrong is a strong one, for both
+// of the sigmas that are checked.
+constexpr double kLower = 10;
+constexpr double kUpper = 100;
+
+/**
+ * @brief The ways that a frame can differ from the base frame.
+ */
+enum FrameChange
+{
+    kBase = 0,          ///< the base frame
+    kSplit = 1,         ///< a gap cuts the edge in two
+    kDemoted = 2,       ///< the strong part of the edge is weak
+    kStrongRight = 4    ///< a strong part is added at the far end of the edge
+};
+
+/**
+ * The base frame has a single horizontal edge across its full width.  It's
+ * strong on the left and weak everywhere else, so the hysteresis keeps the
+ * whole edge.  The changes are all small compared to the frame, but they
+ * determine whether edge pixels far away from them, in tiles that didn't
+ * change, are kept or not.
+ *
+ * @brief Draw one of the frames of the test sequence.
+ * @param size
+ *      frame size; must be 200x100
+ * @param depth
+ *      the frame's depth
+ * @param changes
+ *      a combination of FrameChange values
+ */
+cv::Mat DrawFrame(const cv::Size &size, const int depth, const int changes)
+{
+    const double scale = depth == CV_16U ? 257 : 1;
+    const cv::Rect bottom(0, size.height/2, size.width, size.height/2);
+
+    cv::Mat frame(size, CV_MAKETYPE(depth, 3), cv::Scalar::all(scale*kTop));
+    frame(bottom).setTo(cv::Scalar::all(scale*kWeak));
+
+    if ((changes & kDemoted) == 0)
+    {
+        frame(cv::Rect(0, bottom.y, 40, bottom.height))
+            .setTo(cv::Scalar::all(scale*kStrong));
+    }
+
+    if ((changes & kStrongRight) != 0)
+    {
+        frame(cv::Rect(180, bottom.y, 20, bottom.height))
+            .setTo(cv::Scalar::all(scale*kStrong));
+    }
+
+    // The gap is the same colour as the top half, so there's no edge along
+    // its top.  The edges on either side of it each continue down one of the
+    // gap's sides, but they aren't connected to each other.
+    if ((changes & kSplit) != 0)
+    {
+        frame(cv::Rect(100, 40, 8, size.height - 40))
+            .setTo(cv::Scalar::all(scale*kTop));
+    }
+
+    return frame;
+}
+
+void CheckChains(testutils::TestRun &run, const int depth,
+                 const std::string &name)
+{
+    const double scale = depth == CV_16U ? 257 : 1;
+    const cv::Size size(200, 100);
+
+    // Each step only changes a few of the 32x32 tiles, so none of them fall
+    // back onto a full update.  The middle of the edge, between the gap and
+    // the strong part on the right, is far from every change.
+    struct Step
+    {
+        int changes;
+        bool middle_kept;
+        const char *what;
+    };
+    const std::vector<Step> steps = {
+        {kBase, true, "base frame"},
+        {kSplit, false, "edge split by a gap"},
+        {kBase, true, "edge joined by closing the gap"},
+        {kDemoted, false, "strong part removed"},
+        {kDemoted | kStrongRight, true, "edge joined to a new strong part"},
+        {kDemoted, false, "new strong part removed"},
+        {kDemoted, false, "unchanged frame"},
+        {kBase, true, "strong part restored"}
+    };
+
+    const cv::Rect middle(120, 0, 30, size.height);
+    for (const double sigma : {0.0, 1.5})
+    {
+        VideoEdgeDetector detector(scale*kLower, scale*kUpper, sigma);
+        for (const Step &step : steps)
+        {
+            const cv::Mat frame = DrawFrame(size, depth, step.changes);
+            const cv::Mat expected = ColourCannyEdgeDetect(
+                frame, scale*kLower, scale*kUpper, sigma
+            );
+
+            const std::string what = name + " sigma " + std::to_string(sigma)
+                                     + ", " + step.what;
+
+            // Make sure that the frame really does test what it says.
+            const bool kept = cv::countNonZero(expected(middle)) > 0;
+            run.Check(kept == step.middle_kept, what + " (expected edges)");
+
+            run.Check(testutils::Identical(detector.Detect(frame), expected),
+                      what);
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+int main()
+{
+    testutils::TestRun run;
+
+    CheckChains(run, CV_8U, "8-bit");
+    CheckChains(run, CV_16U, "16-bit");
+
+    return run.Finish();
+}